@@ -186,6 +186,20 @@ void comm_message_send(struct comm_message *msg, uint8_t dest_addr)
 	irq_restore(sreg);
 }
 
+/* Get the number of free TX queue slots.
+ * Sending more messages than this will block.
+ */
+uint8_t comm_tx_queue_free(void)
+{
+	uint8_t sreg, count;
+
+	sreg = irq_disable_save();
+	count = tx.count;
+	irq_restore(sreg);
+
+	return COMM_TX_QUEUE_SIZE - count;
+}
+
 static void handle_rx(const struct comm_message *msg)
 {
 	COMM_MSG(reply);
@@ -108,6 +108,7 @@ void comm_work(void);
 void comm_centisecond_tick(void);
 
 void comm_message_send(struct comm_message *msg, uint8_t dest_addr);
+uint8_t comm_tx_queue_free(void);
 void comm_drain_tx_queue(void);
 
 extern bool comm_handle_rx_message(const struct comm_message *msg,
@@ -159,6 +159,7 @@ static struct controller_config EEMEM eeprom_cont_config = {
 			.to		= (time_of_day_t)(long)-1,
 		},
 		.dow_on_mask		= 0x7F,
+		.temp_coeff		= 0,
 	},
 	.global = {
 		.flags			= CONTR_FLG_ENABLE,
@@ -245,13 +246,35 @@ static void pot_state_enter(struct flowerpot *pot,
 	}
 }
 
+/* Compensate the temperature drift of a raw sensor ADC value.
+ * The compensation is:
+ *   raw_comp = raw * (1 - temp_coeff / 1000 * (temp - temp_ref))
+ * res: Pointer to the sensor result (ADC value).
+ * Returns the compensated raw value.
+ */
+static uint16_t temp_compensate_sensor_val(const struct sensor_result *res)
+{
+	int8_t coeff = cont.config.pots[res->nr].temp_coeff;
+	int8_t temp = rv3029_get_temperature();
+	int32_t value;
+
+	if (!coeff || temp == RV3029_TEMP_UNKNOWN)
+		return res->value;
+
+	value = (int32_t)res->value * coeff * (temp - TEMP_COMP_REF_CELSIUS);
+	value = (int32_t)res->value - value / 1000;
+
+	return clamp(value, 0, SENSOR_MAX);
+}
+
 /* Scale the raw sensor ADC value into the fixed 0-255 moisture range.
+ * The value is temperature compensated before scaling.
  * res: Pointer to the sensor result (ADC value).
  * Returns the 8-bit scaled value.
  */
 static uint8_t scale_sensor_val(const struct sensor_result *res)
 {
-	uint16_t raw_value = res->value;
+	uint16_t raw_value = temp_compensate_sensor_val(res);
 	uint16_t raw_range;
 	uint16_t raw_lowest, raw_highest;
 	uint8_t scaled_value;
@@ -411,6 +434,7 @@ static void pot_reset(struct flowerpot *pot, bool clear_measured)
 	if (clear_measured) {
 		pot->state.last_measured_raw_value = 0;
 		pot->state.last_measured_value = 0;
+		pot->state.last_measured_asym = 0;
 	}
 	pot->next_measurement = jiffies_get() + sec_to_jiffies(FIRST_CTRL_INTERVAL_SEC);
 	pot_state_enter(pot, POT_IDLE);
@@ -466,7 +490,7 @@ static bool pot_check_watchdog(struct flowerpot *pot)
 	/* The watchdog timed out. This is an emergency situation.
 	 * Log the event.
 	 */
-	notify_led_set(1);
+	notify_led_raise(NOTIFY_LED_WATERDOG);
 	pot_info(pot, LOG_ERROR, LOG_ERR_WATERDOG, pot->nr & 0x0F);
 
 	/* Now stop watering and shutdown the pot. */
@@ -533,6 +557,7 @@ static void handle_pot(struct flowerpot *pot)
 {
 	struct sensor_result result;
 	uint8_t sensor_val;
+	int8_t temp;
 	jiffies_t now;
 	bool ok;
 	struct rtc_time rtc;
@@ -623,6 +648,11 @@ static void handle_pot(struct flowerpot *pot)
 			log.sensor_data = LOG_SENSOR_DATA(result.nr,
 							  result.value);
 			log_append(&log);
+
+			/* Log the temperature of this measurement. */
+			temp = rv3029_get_temperature();
+			if (temp != RV3029_TEMP_UNKNOWN)
+				log_info(LOG_INFO_TEMPERATURE, LOG_TEMPERATURE(temp));
 		}
 
 		/* Scale the raw sensor value to the 8-bit
@@ -631,12 +661,14 @@ static void handle_pot(struct flowerpot *pot)
 		sensor_val = scale_sensor_val(&result);
 		pot->state.last_measured_raw_value = result.value;
 		pot->state.last_measured_value = sensor_val;
+		pot->state.last_measured_asym = result.asymmetry;
 
 		/* Sensor value sanity check.
 		 * Too low and too big values are rejected. These values
 		 * indicate a short circuit or cable break.
 		 */
 		if (result.value < 16 || result.value > (SENSOR_MAX - 16)) {
+			notify_led_raise(NOTIFY_LED_SENSOR);
 			pot_info(pot, LOG_ERROR, LOG_ERR_SENSOR, pot->nr);
 			/* Force-stop watering and bail to idle state. */
 			pot_stop_watering(pot);
@@ -871,6 +903,7 @@ void controller_work(void)
 		} else {
 			/* Timeout. Disable freeze. */
 			cont.frozen = 0;
+			notify_led_raise(NOTIFY_LED_FREEZE);
 			log_error(LOG_ERR_FREEZE, 0);
 		}
 	}
@@ -41,8 +41,18 @@ struct flowerpot_config {
 	 * that weekday.
 	 */
 	uint8_t dow_on_mask;
+	/* The temperature coefficient of the sensor.
+	 * In 0.1 percent of the raw sensor value per degree Celsius,
+	 * relative to TEMP_COMP_REF_CELSIUS.
+	 * Zero disables the temperature compensation.
+	 */
+	int8_t temp_coeff;
 };
 
+/* The reference temperature of the sensor temperature compensation,
+ * in degree Celsius. */
+#define TEMP_COMP_REF_CELSIUS	20
+
 enum controller_global_flags {
 	/* Global controller-enable bit.
 	 * If this bit is not set, the controller is disabled globally.
@@ -101,6 +111,8 @@ struct flowerpot_state {
 	uint16_t last_measured_raw_value;
 	/* A copy of the last scaled sensor value. */
 	uint8_t last_measured_value;
+	/* A copy of the last sensor polarity asymmetry. */
+	int16_t last_measured_asym;
 };
 
 enum flowerpot_remanent_flags {
@@ -20,6 +20,14 @@
 
 #include "datetime.h"
 
+#include <avr/pgmspace.h>
+
+
+/* The number of days in each month of a non-leap year. */
+static const uint8_t PROGMEM days_per_month[] = {
+	31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31,
+};
+
 
 /* Convert a binary byte to a BCD value.
  * value: The binary value.
@@ -119,3 +127,45 @@ timestamp_t rtc_get_timestamp(const struct rtc_time *time)
 
 	return s;
 }
+
+/* Get the number of days in the month of an rtc_time structure.
+ * time: The RTC time.
+ * Returns the number of days in that month.
+ */
+static uint8_t rtc_days_in_month(const struct rtc_time *time)
+{
+	uint8_t days;
+
+	days = pgm_read_byte(&days_per_month[time->month % 12]);
+	/* Every fourth year is a leap year (2000 to 2099). */
+	if (time->month == 1 && time->year % 4 == 0)
+		days++;
+
+	return days;
+}
+
+/* Advance an rtc_time structure by one second.
+ * The carry is propagated through all fields, including
+ * the day of the week.
+ * time: The RTC time to advance.
+ */
+void rtc_time_inc_second(struct rtc_time *time)
+{
+	if (++time->second < 60)
+		return;
+	time->second = 0;
+	if (++time->minute < 60)
+		return;
+	time->minute = 0;
+	if (++time->hour < 24)
+		return;
+	time->hour = 0;
+	time->day_of_week = (uint8_t)((time->day_of_week + 1) % 7);
+	if (++time->day < rtc_days_in_month(time))
+		return;
+	time->day = 0;
+	if (++time->month < 12)
+		return;
+	time->month = 0;
+	time->year = (uint8_t)((time->year + 1) % 100);
+}
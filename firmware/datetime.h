@@ -90,4 +90,6 @@ static inline bool time_of_day_before(time_of_day_t time_a,
 
 timestamp_t rtc_get_timestamp(const struct rtc_time *time);
 
+void rtc_time_inc_second(struct rtc_time *time);
+
 #endif /* DATETIME_H_ */
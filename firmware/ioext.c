@@ -19,13 +19,16 @@
  */
 
 #include "ioext.h"
+#include "log.h"
+#include "notify_led.h"
 
 
 struct ioext_context ioext_ctx;
 
 
-/* Write the I/O-extender state out to the hardware
- * shift register.
+/* Request the I/O-extender state to be written out to
+ * the hardware. The write is done by the next ioext_work() call,
+ * so repeated changes are coalesced into one transfer.
  */
 void ioext_commit(void)
 {
@@ -34,17 +37,184 @@ void ioext_commit(void)
 
 	/* For each chip. */
 	for (chip = 0; chip < EXTOUT_NR_CHIPS; chip++) {
-		/* Write the new state to the shift register,
-		 * if it did not change.
-		 */
-		if (ctx->states[chip] != ctx->old_states[chip]) {
-			ctx->old_states[chip] = ctx->states[chip];
-			pcf8574_write(&ctx->chips[chip],
-				      ctx->states[chip]);
-		}
+		/* Only write the new state, if it changed. */
+		if (ctx->states[chip] != ctx->old_states[chip])
+			ctx->dirty_mask |= BITMASK8(chip);
 	}
 }
 
+/* Start writing the requested state of a chip, if it is dirty.
+ * The port is read back in the same transfer to verify the latch.
+ * Returns true, if a transfer was started.
+ */
+static bool ioext_flush(struct ioext_context *ctx, uint8_t chip)
+{
+	if (!(ctx->dirty_mask & BITMASK8(chip)))
+		return 0;
+	if (ctx->backoff_mask & BITMASK8(chip))
+		return 0;
+	ctx->dirty_mask &= ~BITMASK8(chip);
+
+	/* Write the current state.
+	 * This includes all changes since the last write. */
+	ctx->xfer_states[chip] = ctx->states[chip];
+	pcf8574_write_read_async(&ctx->chips[chip], ctx->xfer_states[chip]);
+	ctx->xfer[chip] = IOEXT_XFER_WRITE;
+
+	return 1;
+}
+
+static void count_event(uint16_t *counter)
+{
+	/* Saturating increment. */
+	if (*counter != 0xFFFF)
+		(*counter)++;
+}
+
+/* Log a fault of a chip only once, until it is fixed.
+ * data: The differing bits, or 0 for failed transfers.
+ */
+static void ioext_fault(struct ioext_context *ctx, uint8_t chip,
+			uint8_t data)
+{
+	if (ctx->fault_mask & BITMASK8(chip))
+		return;
+	ctx->fault_mask |= BITMASK8(chip);
+	notify_led_raise(NOTIFY_LED_IOEXT);
+	log_error(LOG_ERR_IOEXT, data);
+}
+
+/* Compare the read-back port state of a chip to the expected state.
+ * Returns true, if the state matched.
+ */
+static bool ioext_verify(struct ioext_context *ctx, uint8_t chip,
+			 enum twi_status status, uint8_t expected)
+{
+	uint8_t value;
+
+	if (status != TWI_STAT_FINISHED) {
+		/* The transfer failed. The output state is unknown.
+		 * Leave the bus alone until the next read-back period
+		 * and log the failure, if it persists. */
+		count_event(&ctx->stats.errors);
+		ctx->backoff_mask |= BITMASK8(chip);
+		if (ctx->errors[chip] < IOEXT_ERROR_LIMIT)
+			ctx->errors[chip]++;
+		if (ctx->errors[chip] >= IOEXT_ERROR_LIMIT)
+			ioext_fault(ctx, chip, 0);
+		return 0;
+	}
+	ctx->errors[chip] = 0;
+
+	value = pcf8574_get_value(&ctx->chips[chip]);
+	if (value != expected) {
+		/* The latch does not hold the written value.
+		 * The chip might have been reset by a brown-out.
+		 * Log the differing bits. */
+		count_event(&ctx->stats.mismatches);
+		ioext_fault(ctx, chip, value ^ expected);
+		return 0;
+	}
+	ctx->fault_mask &= ~BITMASK8(chip);
+
+	return 1;
+}
+
+/* Finish the write of a chip.
+ * The chip is written again, if the write could not be verified
+ * or if the requested state changed meanwhile.
+ */
+static void ioext_flush_done(struct ioext_context *ctx, uint8_t chip,
+			     enum twi_status status)
+{
+	if (ioext_verify(ctx, chip, status, ctx->xfer_states[chip]))
+		ctx->old_states[chip] = ctx->xfer_states[chip];
+	else
+		ctx->dirty_mask |= BITMASK8(chip);
+
+	/* ioext_commit() compared against the old state while the
+	 * write was running. A change back to that state was not
+	 * marked dirty, but the hardware now holds the written one. */
+	if (ctx->states[chip] != ctx->old_states[chip])
+		ctx->dirty_mask |= BITMASK8(chip);
+}
+
+/* Start the periodic read-back of a chip. */
+static void ioext_check(struct ioext_context *ctx, uint8_t chip)
+{
+	pcf8574_read_async(&ctx->chips[chip]);
+	ctx->xfer[chip] = IOEXT_XFER_CHECK;
+}
+
+/* Finish the periodic read-back of a chip.
+ * The chip is written again, if it lost its state.
+ */
+static void ioext_check_done(struct ioext_context *ctx, uint8_t chip,
+			     enum twi_status status)
+{
+	if (!ioext_verify(ctx, chip, status, ctx->old_states[chip]))
+		ctx->dirty_mask |= BITMASK8(chip);
+}
+
+/* Run the transfer state machine of one chip.
+ * This never waits for the bus.
+ */
+static void ioext_chip_work(struct ioext_context *ctx, uint8_t chip,
+			    bool check)
+{
+	enum twi_status status;
+
+	status = pcf8574_get_status(&ctx->chips[chip]);
+	if (status == TWI_STAT_INPROGRESS)
+		return;
+
+	switch (ctx->xfer[chip]) {
+	case IOEXT_XFER_IDLE:
+		break;
+	case IOEXT_XFER_WRITE:
+		ioext_flush_done(ctx, chip, status);
+		break;
+	case IOEXT_XFER_CHECK:
+		ioext_check_done(ctx, chip, status);
+		break;
+	}
+	ctx->xfer[chip] = IOEXT_XFER_IDLE;
+
+	/* The back-off after a failed transfer ends
+	 * with the next read-back period. */
+	if (check)
+		ctx->backoff_mask &= ~BITMASK8(chip);
+
+	/* A pending write takes precedence over the read-back. */
+	if (!ioext_flush(ctx, chip) && check)
+		ioext_check(ctx, chip);
+}
+
+/* Periodic work. Must be called once per mainloop pass.
+ * Starts at most one transfer per chip.
+ */
+void ioext_work(void)
+{
+	struct ioext_context *ctx = &ioext_ctx;
+	jiffies_t now = jiffies_get();
+	bool check = 0;
+	uint8_t chip;
+
+	if (!time_before(now, ctx->next_check)) {
+		ctx->next_check = now + msec_to_jiffies(IOEXT_CHECK_MS);
+		check = 1;
+	}
+
+	for (chip = 0; chip < EXTOUT_NR_CHIPS; chip++)
+		ioext_chip_work(ctx, chip, check);
+}
+
+/* Get a copy of the error counters. */
+void ioext_get_stats(struct ioext_stats *stats)
+{
+	*stats = ioext_ctx.stats;
+}
+
 /* Initialize the I/O-extender.
  * This also initializes the shift register.
  * If "all_ones" is true, all state bits are initialized to 1.
@@ -61,7 +231,9 @@ void ioext_init(bool all_ones)
 		memset(ctx->old_states, 0xFF, sizeof(ctx->states));
 	}
 
-	/* Initialize the shift register. */
+	/* Initialize the shift register.
+	 * The initial state is read back by the first ioext_work(). */
 	for (chip = 0; chip < EXTOUT_NR_CHIPS; chip++)
 		pcf8574_init(&ctx->chips[chip], chip, 1, all_ones);
+	ctx->next_check = jiffies_get();
 }
@@ -2,6 +2,7 @@
 #define IO_EXTENDER_H_
 
 #include "pcf8574.h"
+#include "main.h"
 #include "util.h"
 
 
@@ -16,10 +17,48 @@ enum ioext_bits {
 
 #define EXTOUT_NR_CHIPS		1
 
+/* Interval of the periodic output read-back, in milliseconds.
+ * A chip is not accessed again before the next read-back period,
+ * after one of its transfers failed. */
+#define IOEXT_CHECK_MS		1000
+/* Number of failed transfers in a row, before the failure is logged. */
+#define IOEXT_ERROR_LIMIT	3
+
+/* I/O-extender error counters. All counters saturate. */
+struct ioext_stats {
+	uint16_t errors;		/* Failed transfers. */
+	uint16_t mismatches;		/* Read-back differed from the written state. */
+} _packed;
+
+/* Transfer state of one extender chip. */
+enum ioext_xfer_state {
+	IOEXT_XFER_IDLE,		/* No transfer running. */
+	IOEXT_XFER_WRITE,		/* Writing and reading back xfer_states. */
+	IOEXT_XFER_CHECK,		/* Periodic read-back of old_states. */
+};
+
 struct ioext_context {
 	struct pcf8574_chip chips[EXTOUT_NR_CHIPS];
+	/* The states written to and verified in the hardware. */
 	uint8_t old_states[EXTOUT_NR_CHIPS];
+	/* The requested states. */
 	uint8_t states[EXTOUT_NR_CHIPS];
+	/* The states of the running transfers. */
+	uint8_t xfer_states[EXTOUT_NR_CHIPS];
+	/* The transfer states. (enum ioext_xfer_state) */
+	uint8_t xfer[EXTOUT_NR_CHIPS];
+	/* The number of failed transfers in a row. */
+	uint8_t errors[EXTOUT_NR_CHIPS];
+	/* Bitmask of chips that need to be written. */
+	uint8_t dirty_mask;
+	/* Bitmask of chips that wait for the next read-back period
+	 * after a failed transfer. */
+	uint8_t backoff_mask;
+	/* Bitmask of chips with a logged, not yet fixed, fault. */
+	uint8_t fault_mask;
+	/* Time of the next periodic read-back. */
+	jiffies_t next_check;
+	struct ioext_stats stats;
 };
 
 extern struct ioext_context ioext_ctx;
@@ -63,6 +102,8 @@ static inline void ioext_write_bit(uint8_t bit_number, bool set)
 }
 
 void ioext_commit(void);
+void ioext_work(void);
+void ioext_get_stats(struct ioext_stats *stats);
 
 void ioext_init(bool all_ones);
 
@@ -20,24 +20,42 @@
 
 #include "log.h"
 #include "rv3029.h"
+#include "main.h"
 
 #include <string.h>
 
+#include <avr/eeprom.h>
 
-/* Size of the log ringbuffer, in number of elements. */
-#define LOG_BUFFER_SIZE		24
+
+/* Size of the log ringbuffer, in bytes.
+ * The items are stored in the compact encoding.
+ */
+#ifndef LOG_BUFFER_BYTES
+# define LOG_BUFFER_BYTES	168
+#endif
 
 
 /* Log buffer */
-static struct log_item logbuf[LOG_BUFFER_SIZE];
-/* Current number of elements in the log buffer. */
-static uint8_t logbuf_nr_elems;
+static uint8_t logbuf[LOG_BUFFER_BYTES];
+/* Current number of used bytes in the log buffer. */
+static uint8_t logbuf_used;
+/* Current number of items in the log buffer. */
+static uint8_t logbuf_nr_items;
 /* Write pointer into the log buffer. */
 static uint8_t logbuf_write_ptr;
 /* Read pointer into the log buffer. */
 static uint8_t logbuf_read_ptr;
-/* Overflow notification flag. */
-static bool logbuf_overflow;
+/* Timestamp of the most recently appended item. */
+static timestamp_t logbuf_write_time;
+/* Timestamp of the most recently popped item. */
+static timestamp_t logbuf_read_time;
+/* Sequence number of the oldest item in the log buffer.
+ * The items are numbered consecutively.
+ */
+static uint16_t logbuf_read_seq;
+/* The boot counter. The sequence numbers restart on every boot. */
+static uint8_t log_epoch;
+static uint8_t EEMEM eeprom_log_epoch;
 
 
 /* Initialize a log item.
@@ -49,13 +67,162 @@ void log_init(struct log_item *item, uint8_t type)
 {
 	struct rtc_time rtc;
 
-	rv3029_get_time(&rtc);
-
 	memset(item, 0, sizeof(*item));
+#if LOG_SUBSEC
+	item->subsec = rv3029_get_time_subsec(&rtc);
+#else
+	rv3029_get_time(&rtc);
+#endif
 	item->type_flags = type & LOG_TYPE_MASK;
 	item->time = rtc_get_timestamp(&rtc);
 }
 
+/* Get the size of a compact encoded log item.
+ * header: The header byte of the encoded item.
+ * Returns the size of the item, in bytes.
+ */
+uint8_t log_compact_size(uint8_t header)
+{
+	uint8_t size = 1 + LOG_SUBSEC;
+
+	switch ((header >> LOG_CHDR_TIME_SHIFT) & LOG_CHDR_TIME_MASK) {
+	case LOG_CTIME_SAME:
+		break;
+	case LOG_CTIME_DELTA8:
+		size += 1;
+		break;
+	case LOG_CTIME_DELTA16:
+		size += 2;
+		break;
+	case LOG_CTIME_ABS:
+	default:
+		size += 4;
+		break;
+	}
+	if (((header >> LOG_CHDR_TYPE_SHIFT) & LOG_CHDR_TYPE_MASK) == LOG_SENSOR_DATA)
+		size += 2;
+	else
+		size += 1;
+
+	return size;
+}
+
+/* Encode a log item in the compact format.
+ * buf: The destination buffer. Must be at least LOG_COMPACT_MAXSIZE bytes.
+ * item: The log item to encode. The flags are not encoded.
+ * base: The timestamp base. This is updated to the item's timestamp.
+ * Returns the size of the encoded item, in bytes.
+ */
+uint8_t log_compact_encode(uint8_t *buf, const struct log_item *item,
+			   timestamp_t *base)
+{
+	uint8_t type = item->type_flags & LOG_TYPE_MASK;
+	uint32_t delta;
+	uint8_t code, ctime, i = 1;
+
+	/* Encode the timestamp relative to the base. */
+	delta = item->time - *base;
+	if (item->time < *base) {
+		/* The clock moved backwards. */
+		ctime = LOG_CTIME_ABS;
+		delta = item->time;
+	} else if (delta == 0) {
+		ctime = LOG_CTIME_SAME;
+	} else if (delta <= 0xFF) {
+		ctime = LOG_CTIME_DELTA8;
+	} else if (delta <= 0xFFFF) {
+		ctime = LOG_CTIME_DELTA16;
+	} else {
+		ctime = LOG_CTIME_ABS;
+		delta = item->time;
+	}
+	*base = item->time;
+
+	if (ctime != LOG_CTIME_SAME) {
+		buf[i++] = (uint8_t)delta;
+		if (ctime != LOG_CTIME_DELTA8) {
+			buf[i++] = (uint8_t)(delta >> 8);
+			if (ctime != LOG_CTIME_DELTA16) {
+				buf[i++] = (uint8_t)(delta >> 16);
+				buf[i++] = (uint8_t)(delta >> 24);
+			}
+		}
+	}
+#if LOG_SUBSEC
+	buf[i++] = item->subsec;
+#endif
+
+	/* Encode the payload. */
+	if (type == LOG_SENSOR_DATA) {
+		code = item->sensor_data >> 10;
+		buf[i++] = (uint8_t)item->sensor_data;
+		buf[i++] = (uint8_t)(item->sensor_data >> 8) & 0x03;
+	} else {
+		code = item->code;
+		buf[i++] = item->data;
+	}
+
+	buf[0] = (uint8_t)(((type & LOG_CHDR_TYPE_MASK) << LOG_CHDR_TYPE_SHIFT) |
+			   (ctime << LOG_CHDR_TIME_SHIFT) |
+			   ((code & LOG_CHDR_CODE_MASK) << LOG_CHDR_CODE_SHIFT));
+
+	return i;
+}
+
+/* Decode a log item from the compact format.
+ * item: The destination log item.
+ * buf: The encoded item.
+ * base: The timestamp base. This is updated to the item's timestamp.
+ * Returns the size of the encoded item, in bytes.
+ */
+uint8_t log_compact_decode(struct log_item *item, const uint8_t *buf,
+			   timestamp_t *base)
+{
+	uint8_t header = buf[0];
+	uint8_t type = (header >> LOG_CHDR_TYPE_SHIFT) & LOG_CHDR_TYPE_MASK;
+	uint8_t code = (header >> LOG_CHDR_CODE_SHIFT) & LOG_CHDR_CODE_MASK;
+	uint32_t delta = 0;
+	uint8_t i = 1;
+
+	switch ((header >> LOG_CHDR_TIME_SHIFT) & LOG_CHDR_TIME_MASK) {
+	case LOG_CTIME_SAME:
+		break;
+	case LOG_CTIME_DELTA8:
+		delta = buf[i++];
+		break;
+	case LOG_CTIME_DELTA16:
+		delta = (uint16_t)buf[i] | ((uint16_t)buf[i + 1] << 8);
+		i += 2;
+		break;
+	case LOG_CTIME_ABS:
+	default:
+		*base = (uint32_t)buf[i] |
+			((uint32_t)buf[i + 1] << 8) |
+			((uint32_t)buf[i + 2] << 16) |
+			((uint32_t)buf[i + 3] << 24);
+		i += 4;
+		break;
+	}
+	*base += delta;
+
+	memset(item, 0, sizeof(*item));
+	item->type_flags = type;
+	item->time = *base;
+#if LOG_SUBSEC
+	item->subsec = buf[i++];
+#endif
+	if (type == LOG_SENSOR_DATA) {
+		item->sensor_data = LOG_SENSOR_DATA(code,
+			(uint16_t)buf[i] | ((uint16_t)buf[i + 1] << 8));
+		i += 2;
+	} else {
+		item->code = code;
+		item->data = buf[i++];
+	}
+
+	return i;
+}
+
 /* Write/read pointer increment helper.
  * Honors the pointer wrapping.
  * ptr: Pointer to the write or read pointer variable.
@@ -65,82 +232,691 @@ static void ptr_inc(uint8_t *ptr)
 	/* Increment the pointer. */
 	*ptr += 1;
 	/* If it points beyond the log buffer, wrap to zero. */
-	if (*ptr >= LOG_BUFFER_SIZE)
+	if (*ptr >= LOG_BUFFER_BYTES)
 		*ptr = 0;
 }
 
+/* Copy an encoded item out of the ring.
+ * buf: The destination buffer. Must be at least LOG_COMPACT_MAXSIZE bytes.
+ * ptr: Pointer to the ring read position. This is advanced.
+ * Returns the size of the encoded item, in bytes.
+ */
+static uint8_t logbuf_copy(uint8_t *buf, uint8_t *ptr)
+{
+	uint8_t i, size;
+
+	size = log_compact_size(logbuf[*ptr]);
+	for (i = 0; i < size; i++) {
+		buf[i] = logbuf[*ptr];
+		ptr_inc(ptr);
+	}
+
+	return size;
+}
+
+/* Copy an encoded item out of the ring and decode it.
+ * item: The destination log item.
+ * ptr: Pointer to the ring read position. This is advanced.
+ * base: The timestamp base. This is updated to the item's timestamp.
+ * Returns the size of the encoded item, in bytes.
+ */
+static uint8_t logbuf_decode(struct log_item *item, uint8_t *ptr,
+			     timestamp_t *base)
+{
+	uint8_t buf[LOG_COMPACT_MAXSIZE];
+	uint8_t size;
+
+	size = logbuf_copy(buf, ptr);
+	log_compact_decode(item, buf, base);
+
+	return size;
+}
+
+/* Copy an item out of the ring with interrupts enabled and decode it.
+ * An interrupt may append to the log and overwrite the item meanwhile.
+ * item: The destination log item.
+ * ptr: Pointer to the ring read position. This is advanced.
+ * base: The timestamp base. This is updated to the item's timestamp.
+ * seq: The sequence number of the item.
+ * Returns 0, if the item was dropped from the log buffer meanwhile.
+ */
+static bool logbuf_read(struct log_item *item, uint8_t *ptr,
+			timestamp_t *base, uint16_t seq)
+{
+	uint8_t buf[LOG_COMPACT_MAXSIZE];
+	uint8_t sreg;
+	bool valid;
+
+	logbuf_copy(buf, ptr);
+
+	/* Items are dropped before their bytes are overwritten.
+	 * The copy is intact, if the item is still there. */
+	sreg = irq_disable_save();
+	valid = (int16_t)(seq - logbuf_read_seq) >= 0;
+	irq_restore(sreg);
+
+	if (valid)
+		log_compact_decode(item, buf, base);
+
+	return valid;
+}
+
+/* Remove the oldest item from the log buffer.
+ * Must be called with interrupts disabled.
+ */
+static void log_drop_oldest(void)
+{
+	struct log_item item;
+
+	logbuf_used -= logbuf_decode(&item, &logbuf_read_ptr,
+				     &logbuf_read_time);
+	logbuf_nr_items--;
+	logbuf_read_seq++;
+}
+
 /* Append an item to the log buffer.
  * item: Pointer to the log item to add.
+ * Returns the sequence number of the item.
  */
-void log_append(const struct log_item *item)
+uint16_t log_append(const struct log_item *item)
 {
+	uint8_t buf[LOG_COMPACT_MAXSIZE];
+	uint16_t seq;
+	uint8_t i, size;
 	uint8_t sreg;
 
+	build_assert(LOG_BUFFER_BYTES <= 0xFF);
+
 	sreg = irq_disable_save();
 
-	if (logbuf_nr_elems >= LOG_BUFFER_SIZE) {
+	size = log_compact_encode(buf, item, &logbuf_write_time);
+
+	while (LOG_BUFFER_BYTES - logbuf_used < size) {
 		/* Overflow. Drop the oldest element */
-		log_pop(NULL);
-		logbuf_overflow = 1;
+		log_drop_oldest();
 	}
 
-	/* Copy the log item to the log item at
-	 * the write pointer. */
-	logbuf[logbuf_write_ptr] = *item;
-	/* Increment the write pointer and increment the
-	 * number of elements. */
-	ptr_inc(&logbuf_write_ptr);
-	logbuf_nr_elems++;
+	/* Copy the encoded item to the write pointer. */
+	for (i = 0; i < size; i++) {
+		logbuf[logbuf_write_ptr] = buf[i];
+		ptr_inc(&logbuf_write_ptr);
+	}
+	logbuf_used += size;
+	seq = logbuf_read_seq + logbuf_nr_items;
+	logbuf_nr_items++;
 
 	irq_restore(sreg);
+
+	return seq;
+}
+
+#if LOG_PERSIST
+
+/* Number of persistent log slots in the EEPROM. */
+#ifndef LOG_PERSIST_SLOTS
+# define LOG_PERSIST_SLOTS		8
+#endif
+
+/* Minimum time between two persistent log writes, in milliseconds.
+ * This limits the EEPROM wear, if an error repeats quickly.
+ */
+#ifndef LOG_PERSIST_INTERVAL_MS
+# define LOG_PERSIST_INTERVAL_MS	60000
+#endif
+
+/* A persistent log slot in the EEPROM. */
+struct log_persist_slot {
+	/* The log item. */
+	struct log_item item;
+	/* Generation number. Increments with each written slot. */
+	uint8_t gen;
+	/* Checksum over the item and the generation number. */
+	uint8_t check;
+} _packed;
+
+/* Persistent log state. */
+struct log_persist {
+	/* The slot that is written next. */
+	uint8_t slot;
+	/* The generation number of the slot that is written next. */
+	uint8_t gen;
+	/* The slot data that is currently written. */
+	struct log_persist_slot buf;
+	/* The number of bytes of 'buf' still to write. Zero if idle. */
+	uint8_t write_count;
+	/* The earliest time of the next write. */
+	jiffies_t next_write;
+
+	/* The most recent item that waits for the next write.
+	 * A newer item replaces it. */
+	struct log_item pending;
+	/* The log sequence number of the pending item. */
+	uint16_t pending_seq;
+	/* 'pending' is valid. */
+	bool have_pending;
+
+	/* The newest slot that was written (or restored) and whose
+	 * item the host did not acknowledge, yet. */
+	uint8_t ack_gen;
+	/* The log sequence number of that slot's item. */
+	uint16_t ack_seq;
+	/* 'ack_gen' and 'ack_seq' are valid. */
+	bool ack_wait;
+	/* The newest acknowledged slot, to be marked in the EEPROM. */
+	uint8_t acked_gen;
+	/* 'acked_gen' is valid. */
+	bool ack_done;
+};
+
+static struct log_persist log_persist;
+
+/* The persistent log slots.
+ * The slots are written round robin, so that the EEPROM wear
+ * is distributed over all slots.
+ */
+static struct log_persist_slot EEMEM eeprom_log_persist[LOG_PERSIST_SLOTS];
+/* The generation number of the newest slot that the host
+ * acknowledged. This slot and all older slots are not
+ * restored on boot.
+ */
+static uint8_t EEMEM eeprom_log_persist_acked = 0xFF;
+
+/* Calculate the checksum of a persistent log slot. */
+static uint8_t log_persist_checksum(const struct log_persist_slot *slot)
+{
+	const uint8_t *p = (const uint8_t *)slot;
+	uint8_t i, check = 0xA5;
+
+	for (i = 0; i < offsetof(struct log_persist_slot, check); i++)
+		check = (uint8_t)((check << 1) | (check >> 7)) ^ p[i];
+
+	return check;
+}
+
+/* Read a persistent log slot from the EEPROM.
+ * Returns 1, if the slot contains a valid item.
+ */
+static bool log_persist_read(struct log_persist_slot *slot, uint8_t index)
+{
+	eeprom_read_block_wdtsafe(slot, &eeprom_log_persist[index],
+				  sizeof(*slot));
+
+	return slot->item.type_flags == LOG_ERROR &&
+	       slot->check == log_persist_checksum(slot);
+}
+
+/* Queue a log item for the persistent log.
+ * The item replaces an older item that still waits for the
+ * LOG_PERSIST_INTERVAL_MS write interval.
+ * seq: The log sequence number of the item.
+ * Must be called with interrupts disabled.
+ */
+static void log_persist_queue(const struct log_item *item, uint16_t seq)
+{
+	struct log_persist *lp = &log_persist;
+
+	if (lp->have_pending && (int16_t)(seq - lp->pending_seq) < 0)
+		return;
+	lp->pending = *item;
+	lp->pending.type_flags &= LOG_TYPE_MASK;
+	lp->pending_seq = seq;
+	lp->have_pending = 1;
+}
+
+/* The host acknowledged the log item with the sequence number 'seq'.
+ * Must be called with interrupts disabled.
+ */
+static void log_persist_ack(uint16_t seq)
+{
+	struct log_persist *lp = &log_persist;
+
+	if (lp->have_pending && lp->pending_seq == seq) {
+		/* The host has the item. It does not need to
+		 * survive a reset anymore. */
+		lp->have_pending = 0;
+	}
+	if (lp->ack_wait && lp->ack_seq == seq) {
+		lp->acked_gen = lp->ack_gen;
+		lp->ack_wait = 0;
+		lp->ack_done = 1;
+	}
 }
 
-/* Pop the oldest item from the log buffer.
- * item: The destination buffer.
- * Returns 1, if the buffer was non-empty and an item was fetched.
- * Returns 0 otherwise.
+/* Write the queued persistent log item to the EEPROM.
+ * This writes at most one byte per call and never waits for
+ * the EEPROM.
  */
-bool log_pop(struct log_item *item)
+static void log_persist_work(void)
 {
+	struct log_persist *lp = &log_persist;
+	uint8_t *dst;
+	uint8_t offset, value;
 	uint8_t sreg;
 
+	if (!eeprom_is_ready())
+		return;
+
+	sreg = irq_disable_save();
+	if (!lp->write_count) {
+		if (lp->ack_done) {
+			/* Mark the acknowledged slots. */
+			lp->ack_done = 0;
+			value = lp->acked_gen;
+			irq_restore(sreg);
+			eeprom_update_byte(&eeprom_log_persist_acked, value);
+			return;
+		}
+		if (!lp->have_pending ||
+		    time_before(jiffies_get(), lp->next_write)) {
+			irq_restore(sreg);
+			return;
+		}
+		/* Start writing the pending item. */
+		lp->buf.item = lp->pending;
+		lp->buf.gen = lp->gen;
+		lp->buf.check = log_persist_checksum(&lp->buf);
+		lp->write_count = sizeof(lp->buf);
+		lp->ack_gen = lp->gen;
+		lp->ack_seq = lp->pending_seq;
+		lp->ack_wait = 1;
+		lp->have_pending = 0;
+	}
+	offset = (uint8_t)(sizeof(lp->buf) - lp->write_count);
+	value = ((const uint8_t *)&lp->buf)[offset];
+	irq_restore(sreg);
+
+	dst = (uint8_t *)&eeprom_log_persist[lp->slot] + offset;
+	if (eeprom_read_byte(dst) != value)
+		eeprom_write_byte(dst, value);
+
 	sreg = irq_disable_save();
+	lp->write_count--;
+	if (!lp->write_count) {
+		/* The slot is complete. Advance to the next one. */
+		lp->slot = (uint8_t)((lp->slot + 1) % LOG_PERSIST_SLOTS);
+		lp->gen++;
+		lp->next_write = jiffies_get() +
+				 msec_to_jiffies(LOG_PERSIST_INTERVAL_MS);
+	}
+	irq_restore(sreg);
+}
+
+/* Find the newest persistent item and merge the persistent
+ * items that the host did not acknowledge into the log buffer.
+ * The restored items are preceded by a LOG_INFO_PERSISTED item.
+ * This must be called once on boot, after the RTC was initialized.
+ */
+static void log_persist_restore(void)
+{
+	struct log_persist *lp = &log_persist;
+	struct log_persist_slot slot, next;
+	uint8_t i, newest = LOG_PERSIST_SLOTS - 1;
+	uint8_t acked_age, count = 0;
+	bool valid, next_valid;
+
+	/* The newest slot is the last one of the chain of
+	 * consecutive generation numbers. */
+	next_valid = log_persist_read(&next, 0);
+	for (i = 0; i < LOG_PERSIST_SLOTS; i++) {
+		slot = next;
+		valid = next_valid;
+		next_valid = log_persist_read(&next,
+					      (uint8_t)((i + 1) % LOG_PERSIST_SLOTS));
+		if (valid && (!next_valid || next.gen != (uint8_t)(slot.gen + 1))) {
+			newest = i;
+			lp->gen = (uint8_t)(slot.gen + 1);
+		}
+	}
+	lp->slot = (uint8_t)((newest + 1) % LOG_PERSIST_SLOTS);
+
+	/* The slots that are at least as old as the acknowledged
+	 * slot were received by the host before the reset. */
+	acked_age = (uint8_t)(lp->gen - eeprom_read_byte(&eeprom_log_persist_acked));
+	if (!acked_age) {
+		/* The mark is older than all slots. */
+		acked_age = 0xFF;
+	}
+	for (i = 1; i <= LOG_PERSIST_SLOTS; i++) {
+		if (log_persist_read(&slot, (uint8_t)((newest + i) % LOG_PERSIST_SLOTS)) &&
+		    (uint8_t)(lp->gen - slot.gen) < acked_age)
+			count++;
+	}
+	if (!count)
+		return;
+
+	/* Append the items, oldest first. */
+	log_info(LOG_INFO_PERSISTED, count);
+	for (i = 1; i <= LOG_PERSIST_SLOTS; i++) {
+		if (log_persist_read(&slot, (uint8_t)((newest + i) % LOG_PERSIST_SLOTS)) &&
+		    (uint8_t)(lp->gen - slot.gen) < acked_age) {
+			log_append(&slot.item);
+			lp->ack_gen = slot.gen;
+		}
+	}
+	/* Mark the slots, once the host has the newest one. */
+	lp->ack_seq = (uint16_t)(log_end_seq() - 1);
+	lp->ack_wait = 1;
+}
+
+#else /* LOG_PERSIST */
+
+static inline void log_persist_queue(const struct log_item *item, uint16_t seq) { }
+static inline void log_persist_ack(uint16_t seq) { }
+static inline void log_persist_work(void) { }
+static inline void log_persist_restore(void) { }
+
+#endif /* LOG_PERSIST */
+
+/* Fetch items, starting at a sequence number.
+ * If 'ack' is set, all items before the requested sequence number
+ * are considered received by the host and are removed from the
+ * log buffer. Otherwise the items are only read.
+ * If the requested items were lost already,
+ * the fetch starts at the oldest item.
+ * Interrupts are disabled for one item at a time only.
+ * buf: The destination buffer for the compact encoded items.
+ * size: The size of the destination buffer.
+ * seq: The requested sequence number.
+ *      Returns the sequence number of the first fetched item.
+ * ack: Remove the items before the requested sequence number.
+ * base: The timestamp base of the first item.
+ *       Returns the timestamp of the last fetched item.
+ * flags: Returns LOG_OVERFLOW, if requested items were lost.
+ * Returns the number of fetched items.
+ */
+uint8_t log_fetch(uint8_t *buf, uint8_t size,
+		  uint16_t *seq, bool ack,
+		  timestamp_t *base, uint8_t *flags)
+{
+	struct log_item item;
+	timestamp_t read_time, enc_base;
+	uint8_t enc[LOG_COMPACT_MAXSIZE];
+	uint16_t read_seq, write_seq;
+	uint8_t ptr, enc_size;
+	uint8_t count, used;
+	uint8_t sreg;
 
-	if (!logbuf_nr_elems) {
-		/* Log buffer is empty. */
+	*flags = 0;
+retry:
+	while (1) {
+		sreg = irq_disable_save();
+		write_seq = logbuf_read_seq + logbuf_nr_items;
+		if ((int16_t)(*seq - logbuf_read_seq) < 0 ||
+		    (int16_t)(write_seq - *seq) < 0) {
+			/* The requested items are not available. */
+			*flags = LOG_OVERFLOW;
+			*seq = logbuf_read_seq;
+		}
+		if (!ack || logbuf_read_seq == *seq)
+			break;
+		/* Remove one item the host already has. */
+		log_persist_ack(logbuf_read_seq);
+		log_drop_oldest();
 		irq_restore(sreg);
-		return 0;
+	}
+	/* Snapshot the read position. */
+	ptr = logbuf_read_ptr;
+	read_time = logbuf_read_time;
+	read_seq = logbuf_read_seq;
+	irq_restore(sreg);
+
+	/* Skip the items before the requested one. */
+	while (read_seq != *seq) {
+		if (!logbuf_read(&item, &ptr, &read_time, read_seq)) {
+			/* The log overflowed meanwhile. */
+			goto retry;
+		}
+		read_seq++;
 	}
 
-	if (item) {
-		/* Copy the item at read-pointer into
-		 * the destination buffer. */
-		*item = logbuf[logbuf_read_ptr];
-		/* Add the overflow flag, if the log buffer had
-		 * an overflow earlier. */
-		if (logbuf_overflow)
-			item->type_flags |= LOG_OVERFLOW;
-		logbuf_overflow = 0;
+	enc_base = *base;
+	count = 0;
+	used = 0;
+	while (read_seq != write_seq && count < LOG_FETCH_MAX_ITEMS) {
+		if (!logbuf_read(&item, &ptr, &read_time, read_seq)) {
+			if (count)
+				break;
+			goto retry;
+		}
+		enc_size = log_compact_encode(enc, &item, &enc_base);
+		if (used + enc_size > size)
+			break;
+		memcpy(buf + used, enc, enc_size);
+		used += enc_size;
+		count++;
+		read_seq++;
+		*base = enc_base;
 	}
 
-	/* Increment the read pointer and decrement the
-	 * number of elements. */
-	ptr_inc(&logbuf_read_ptr);
-	logbuf_nr_elems--;
+	return count;
+}
+
+/* Get the boot counter of the sequence numbers. */
+uint8_t log_get_epoch(void)
+{
+	return log_epoch;
+}
+
+/* Get the sequence number of the oldest item. */
+uint16_t log_start_seq(void)
+{
+	uint16_t seq;
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	seq = logbuf_read_seq;
+	irq_restore(sreg);
+
+	return seq;
+}
+
+/* Get the sequence number the next appended item will get. */
+uint16_t log_end_seq(void)
+{
+	uint16_t seq;
+	uint8_t sreg;
 
+	sreg = irq_disable_save();
+	seq = logbuf_read_seq + logbuf_nr_items;
 	irq_restore(sreg);
 
+	return seq;
+}
+
+/* Number of repetition filter slots. */
+#ifndef LOG_FILTER_SLOTS
+# define LOG_FILTER_SLOTS	4
+#endif
+
+/* Repetition filter slot. */
+struct log_filter_slot {
+	/* The most recent item. */
+	struct log_item item;
+	/* Number of suppressed repetitions. */
+	uint8_t count;
+	/* Time the item last passed the filter. */
+	jiffies_t passed;
+};
+
+/* The filter configuration. */
+static struct log_config log_config;
+/* The repetition filter. */
+static struct log_filter_slot log_filter_slots[LOG_FILTER_SLOTS];
+
+/* The default filter configuration. */
+#define LOG_CONFIG_DEFAULTS {		\
+	.info_mask		= 0xFFFF,	\
+	.error_code_limit	= 0,		\
+	.info_code_limit	= 0,		\
+	.repeat_sec		= 60,		\
+}
+
+static struct log_config EEMEM eeprom_log_config = LOG_CONFIG_DEFAULTS;
+
+/* Sanitize a filter configuration.
+ * Rate limits for undefined codes are implausible. This is what an
+ * erased or corrupted EEPROM reads. Fall back to the defaults then.
+ * conf: The configuration to sanitize.
+ */
+static void log_config_sanitize(struct log_config *conf)
+{
+	if ((conf->error_code_limit & ~(((uint16_t)1 << LOG_NR_ERRORS) - 1)) ||
+	    (conf->info_code_limit & ~(((uint16_t)1 << LOG_NR_INFOS) - 1)))
+		*conf = (struct log_config)LOG_CONFIG_DEFAULTS;
+}
+
+/* Check whether an item is a repetition of a filter slot's item. */
+static bool log_filter_match(const struct log_filter_slot *slot,
+			     const struct log_item *item)
+{
+	uint16_t code_limit;
+
+	if (slot->item.type_flags != item->type_flags ||
+	    slot->item.code != item->code)
+		return 0;
+
+	if (item->type_flags == LOG_ERROR)
+		code_limit = log_config.error_code_limit;
+	else
+		code_limit = log_config.info_code_limit;
+	if (code_limit & ((uint16_t)1 << (item->code & 0xF)))
+		return 1;
+
+	return slot->item.data == item->data;
+}
+
+/* Report the suppressed repetitions of a filter slot.
+ * This appends a LOG_INFO_REPEATED item, followed by the
+ * most recently suppressed item.
+ * slot: A copy of the filter slot.
+ */
+static void log_filter_report(const struct log_filter_slot *slot)
+{
+	struct log_item log;
+
+	if (!slot->count)
+		return;
+
+	log_init(&log, LOG_INFO);
+	log.code = LOG_INFO_REPEATED;
+	log.data = slot->count;
+	log_append(&log);
+	log_append(&slot->item);
+}
+
+/* Run an item through the repetition filter.
+ * Must be called with interrupts disabled.
+ * flush: Returns a copy of the slot that was reused.
+ *        Its repetitions must be reported with log_filter_report().
+ * Returns 1, if the item shall be logged.
+ */
+static bool log_filter(const struct log_item *item,
+		       struct log_filter_slot *flush)
+{
+	struct log_filter_slot *slot, *victim = NULL;
+	jiffies_t now, interval;
+	uint8_t i;
+
+	flush->count = 0;
+	if (item->type_flags == LOG_INFO &&
+	    !(log_config.info_mask & ((uint16_t)1 << (item->code & 0xF)))) {
+		/* This info code is disabled. */
+		return 0;
+	}
+	if (!log_config.repeat_sec)
+		return 1;
+
+	now = jiffies_get();
+	interval = sec_to_jiffies(log_config.repeat_sec);
+
+	for (i = 0; i < LOG_FILTER_SLOTS; i++) {
+		slot = &log_filter_slots[i];
+		if (slot->item.type_flags == LOG_SENSOR_DATA) {
+			/* Unused slot. */
+			victim = slot;
+			continue;
+		}
+		if (log_filter_match(slot, item)) {
+			if (time_before(now, slot->passed + interval)) {
+				/* Suppress the repetition. */
+				slot->item = *item;
+				if (slot->count < 0xFF)
+					slot->count++;
+				return 0;
+			}
+			victim = slot;
+			break;
+		}
+		if (!victim ||
+		    (victim->item.type_flags != LOG_SENSOR_DATA &&
+		     time_before(slot->passed, victim->passed)))
+			victim = slot;
+	}
+
+	/* Track the item in the matching, a free or the oldest slot. */
+	*flush = *victim;
+	victim->count = 0;
+	victim->item = *item;
+	victim->passed = now;
+
 	return 1;
 }
 
+/* Get the current log filter configuration. */
+void log_get_config(struct log_config *dest)
+{
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	*dest = log_config;
+	irq_restore(sreg);
+}
+
+/* Set a new log filter configuration.
+ * The configuration is sanitized, activated and stored to the EEPROM.
+ */
+void log_update_config(const struct log_config *src)
+{
+	struct log_config conf = *src;
+	uint8_t sreg;
+
+	log_config_sanitize(&conf);
+
+	sreg = irq_disable_save();
+	log_config = conf;
+	irq_restore(sreg);
+
+	eeprom_update_block_wdtsafe(&log_config, &eeprom_log_config,
+				    sizeof(log_config));
+}
+
 void log_event(uint8_t type, uint8_t code, uint8_t data)
 {
 	struct log_item log;
+	struct log_filter_slot flush;
+	uint16_t seq;
+	uint8_t sreg;
+	bool pass;
 
 	log_init(&log, type);
 	log.code = code;
 	log.data = data;
-	log_append(&log);
+
+	sreg = irq_disable_save();
+	pass = log_filter(&log, &flush);
+	irq_restore(sreg);
+
+	/* Append outside of the filter's critical section.
+	 * log_append() disables interrupts on its own. */
+	log_filter_report(&flush);
+	if (pass) {
+		seq = log_append(&log);
+		if (type == LOG_ERROR) {
+			sreg = irq_disable_save();
+			log_persist_queue(&log, seq);
+			irq_restore(sreg);
+		}
+	}
 }
 
 void log_info(uint8_t code, uint8_t data)
@@ -152,3 +928,49 @@ void log_error(uint8_t code, uint8_t data)
 {
 	log_event(LOG_ERROR, code, data);
 }
+
+/* Log background work. Must be called from the mainloop. */
+void log_work(void)
+{
+	struct log_filter_slot *slot, flush;
+	jiffies_t now;
+	uint8_t i, sreg;
+
+	/* Report repetitions whose interval expired. */
+	now = jiffies_get();
+	for (i = 0; i < LOG_FILTER_SLOTS; i++) {
+		slot = &log_filter_slots[i];
+		flush.count = 0;
+		sreg = irq_disable_save();
+		if (slot->count &&
+		    !time_before(now, slot->passed +
+				      sec_to_jiffies(log_config.repeat_sec))) {
+			flush = *slot;
+			slot->count = 0;
+		}
+		irq_restore(sreg);
+		log_filter_report(&flush);
+	}
+
+	log_persist_work();
+}
+
+/* Initialize the logging.
+ * This must be called once on boot, after the RTC was initialized.
+ */
+void log_setup(void)
+{
+	uint8_t i;
+
+	eeprom_read_block_wdtsafe(&log_config, &eeprom_log_config,
+				  sizeof(log_config));
+	log_config_sanitize(&log_config);
+	for (i = 0; i < LOG_FILTER_SLOTS; i++)
+		log_filter_slots[i].item.type_flags = LOG_SENSOR_DATA;
+
+	log_persist_restore();
+
+	/* Count the boots, so that the host can tell them apart. */
+	log_epoch = eeprom_read_byte(&eeprom_log_epoch) + 1;
+	eeprom_write_byte(&eeprom_log_epoch, log_epoch);
+}
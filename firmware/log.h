@@ -3,6 +3,21 @@
 
 #include "util.h"
 #include "datetime.h"
+#include "rv3029.h"
+
+
+/* Add a sub-second part to the log item timestamps.
+ * This costs one byte per item. The part is only exact, if the
+ * RTC interrupt keeps the clock phase in sync with the RTC.
+ */
+#ifndef LOG_SUBSEC
+# define LOG_SUBSEC		RV3029_IRQ
+#endif
+
+/* Keep the most recent LOG_ERROR items in EEPROM across resets. */
+#ifndef LOG_PERSIST
+# define LOG_PERSIST		0
+#endif
 
 
 /* Log message types. */
@@ -19,10 +34,18 @@ enum log_type_flags {
 	LOG_OVERFLOW	= 0x80,
 };
 
+/* Error and info codes must be smaller than 16
+ * to fit into the compact log encoding.
+ */
+
 enum log_error {
 	LOG_ERR_SENSOR,			/* Sensor short circuit. */
 	LOG_ERR_WATERDOG,		/* Watering-watchdog fired. */
 	LOG_ERR_FREEZE,			/* Freeze timeout. */
+	LOG_ERR_RTC,			/* RTC EEPROM write failed. */
+	LOG_ERR_IOEXT,			/* Valve output fault. Data: Differing bits,
+					 * or 0 for failed transfers. */
+	LOG_NR_ERRORS,
 };
 
 enum log_info {
@@ -30,18 +53,38 @@ enum log_info {
 	LOG_INFO_CONTSTATCHG,		/* Controller status change */
 	LOG_INFO_WATERINGCHG,		/* The "watering" state changed. */
 	LOG_INFO_HWONOFF,		/* State of the hardware on/off-switch changed. */
+	LOG_INFO_TEMPERATURE,		/* Temperature, plus 60 degree Celsius. */
+	LOG_INFO_PERSISTED,		/* Number of restored persistent items following. */
+	LOG_INFO_REPEATED,		/* Number of suppressed repetitions of the following item. */
+	LOG_INFO_RESET,			/* Reset cause. MCUCSR flags, plus phase in bits 4-7. */
+	LOG_NR_INFOS,
 };
 
 /* Construct a 'sensor_data' field. */
 #define LOG_SENSOR_DATA(sensor_nr, value)	\
 	(((sensor_nr) << 10) | ((value) & 0x3FF))
 
+/* Construct the data field of a LOG_INFO_TEMPERATURE item.
+ * temp: The temperature in degree Celsius. */
+#define LOG_TEMPERATURE(temp)			\
+	((uint8_t)((temp) + 60))
+
+/* Construct the data field of a LOG_INFO_RESET item.
+ * phase: The mainloop phase. (enum postmortem_phase)
+ * flags: The MCUCSR reset flags. */
+#define LOG_RESET(phase, flags)			\
+	((uint8_t)(((phase) << 4) | ((flags) & 0x0F)))
+
 /* Log message item. */
 struct log_item {
 	/* Log message type and flags. */
 	uint8_t type_flags;
 	/* Timestamp of the event occurrence. */
 	timestamp_t time;
+#if LOG_SUBSEC
+	/* Sub-second part of the timestamp, in jiffies (0 to JPS - 1). */
+	uint8_t subsec;
+#endif
 
 	union {
 		/* LOG_ERROR and LOG_INFO */
@@ -63,9 +106,76 @@ struct log_item {
 } _packed;
 
 
+/* Compact log item encoding.
+ *
+ * Each encoded item starts with a header byte:
+ *  Bit 0-1:	Log type (LOG_ERROR, LOG_INFO or LOG_SENSOR_DATA).
+ *  Bit 2-3:	Timestamp encoding (enum log_compact_time).
+ *  Bit 4-7:	Error/info code or sensor number.
+ * The header byte is followed by the timestamp delta (0, 1, 2 or 4
+ * bytes, little endian), the sub-second byte (only if LOG_SUBSEC)
+ * and the payload: One data byte for LOG_ERROR
+ * and LOG_INFO or the 10 bit sensor value (2 bytes, little endian)
+ * for LOG_SENSOR_DATA.
+ *
+ * The timestamp is encoded as difference to the timestamp of the
+ * previously encoded item (the 'base').
+ */
+enum log_compact_time {
+	LOG_CTIME_SAME,		/* Same timestamp as the base. */
+	LOG_CTIME_DELTA8,	/* 8 bit delta to the base. */
+	LOG_CTIME_DELTA16,	/* 16 bit delta to the base. */
+	LOG_CTIME_ABS,		/* Absolute 32 bit timestamp. */
+};
+
+#define LOG_CHDR_TYPE_SHIFT	0
+#define LOG_CHDR_TYPE_MASK	0x03
+#define LOG_CHDR_TIME_SHIFT	2
+#define LOG_CHDR_TIME_MASK	0x03
+#define LOG_CHDR_CODE_SHIFT	4
+#define LOG_CHDR_CODE_MASK	0x0F
+
+/* The maximum size of an encoded log item, in bytes. */
+#define LOG_COMPACT_MAXSIZE	(1 + sizeof(timestamp_t) + LOG_SUBSEC + 2)
+
+uint8_t log_compact_size(uint8_t header);
+uint8_t log_compact_encode(uint8_t *buf, const struct log_item *item,
+			   timestamp_t *base);
+uint8_t log_compact_decode(struct log_item *item, const uint8_t *buf,
+			   timestamp_t *base);
+
 void log_init(struct log_item *item, uint8_t type);
-void log_append(const struct log_item *item);
-bool log_pop(struct log_item *item);
+/* Log filter configuration. */
+struct log_config {
+	/* Bit mask of the enabled LOG_INFO codes. */
+	uint16_t info_mask;
+	/* Bit masks of the LOG_ERROR and LOG_INFO codes that are
+	 * rate limited per code. Items with such a code count as
+	 * repetition, even if their data differs.
+	 */
+	uint16_t error_code_limit;
+	uint16_t info_code_limit;
+	/* Repetition interval, in seconds.
+	 * Repetitions of a LOG_ERROR or LOG_INFO item within this
+	 * interval are suppressed and counted.
+	 * Zero disables the suppression.
+	 */
+	uint8_t repeat_sec;
+} _packed;
+
+void log_get_config(struct log_config *dest);
+void log_update_config(const struct log_config *src);
+
+/* The maximum number of items in one log_fetch() batch. */
+#define LOG_FETCH_MAX_ITEMS	7
+
+uint16_t log_append(const struct log_item *item);
+uint8_t log_fetch(uint8_t *buf, uint8_t size,
+		  uint16_t *seq, bool ack,
+		  timestamp_t *base, uint8_t *flags);
+uint16_t log_start_seq(void);
+uint16_t log_end_seq(void);
+uint8_t log_get_epoch(void);
 
 void log_event(uint8_t type, uint8_t code, uint8_t data);
 
@@ -76,4 +186,7 @@ static inline void log_debug(uint8_t data)
 	log_info(LOG_INFO_DEBUG, data);
 }
 
+void log_work(void);
+void log_setup(void);
+
 #endif /* LOG_H_ */
@@ -26,6 +26,8 @@
 #include "log.h"
 #include "twi_master.h"
 #include "pcf8574.h"
+#include "ioext.h"
+#include "postmortem.h"
 #include "rv3029.h"
 #include "notify_led.h"
 #include "onoffswitch.h"
@@ -34,10 +36,6 @@
 #include <avr/wdt.h>
 
 
-/* RTC time fetch interval, in milliseconds. */
-#define RTC_FETCH_INTERVAL_MS		1000
-
-
 /* Message IDs of control messages transferred to and from
  * the host over serial wire. */
 enum user_message_id {
@@ -57,8 +55,43 @@ enum user_message_id {
 	MSG_MAN_MODE_FETCH,		/* Manual mode settings request */
 	MSG_CONTR_STATE,		/* Global state */
 	MSG_CONTR_STATE_FETCH,		/* Global state request */
+	MSG_SENSOR_CONF,		/* Sensor configuration */
+	MSG_SENSOR_CONF_FETCH,		/* Sensor configuration request */
+	MSG_SENSOR_STREAM,		/* Raw ADC stream samples */
+	MSG_SENSOR_STREAM_CTL,		/* Raw ADC stream control */
+	MSG_LOG_CONF,			/* Log filter configuration */
+	MSG_LOG_CONF_FETCH,		/* Log filter configuration request */
+	MSG_IOEXT_STATS,		/* Valve I/O-extender error counters */
+	MSG_IOEXT_STATS_FETCH,		/* Valve I/O-extender error counters request */
+	MSG_RESET_INFO,			/* Post-mortem info of the last reset */
+	MSG_RESET_INFO_FETCH,		/* Post-mortem info request */
 };
 
+enum log_fetch_flags {
+	LOGFETCH_RESYNC		= 1 << 0, /* The host does not know the epoch. */
+};
+
+/* Mask of the item count in the MSG_LOG 'count_flags' field.
+ * The field also holds the LOG_OVERFLOW, MSG_LOG_SUBSEC,
+ * MSG_LOG_MORE, MSG_LOG_CHAINED and MSG_LOG_EPOCH flags.
+ */
+#define MSG_LOG_COUNT_MASK	0x07
+/* MSG_LOG flag: The message carries no items, but the log epoch
+ * in data[0]. 'seq' is the sequence number of the oldest item.
+ * This is the reply to a fetch with a different epoch. */
+#define MSG_LOG_EPOCH		0x08
+/* MSG_LOG flag: The timestamp base of the first item is the
+ * last item of the previous MSG_LOG message of this fetch.
+ * Otherwise the timestamp base is zero. */
+#define MSG_LOG_CHAINED		0x10
+/* MSG_LOG flag: More MSG_LOG messages of this fetch follow. */
+#define MSG_LOG_MORE		0x20
+/* MSG_LOG flag: The items have a sub-second timestamp byte. */
+#define MSG_LOG_SUBSEC		0x40
+
+/* The maximum number of samples in one MSG_SENSOR_STREAM message. */
+#define MSG_STREAM_MAX_SAMPLES	2
+
 enum man_mode_flags {
 	MANFLG_FREEZE_CHANGE	= 1 << 0, /* Freeze change request */
 	MANFLG_FREEZE_ENABLE	= 1 << 1, /* Freeze on/off */
@@ -79,9 +112,28 @@ struct msg_payload {
 	union {
 		/* Log message. */
 		struct {
-			struct log_item item;
+			/* Number of items and flags. */
+			uint8_t count_flags;
+			/* Sequence number of the first item. */
+			uint16_t seq;
+			/* Items in the compact log encoding.
+			 * See MSG_LOG_CHAINED for the timestamp base.
+			 */
+			uint8_t data[COMM_PAYLOAD_LEN - 4];
 		} _packed log;
 
+		/* Log fetch request. */
+		struct {
+			/* Flags. (enum log_fetch_flags) */
+			uint8_t flags;
+			/* Sequence number of the first requested item.
+			 * All items before it are acknowledged.
+			 */
+			uint16_t seq;
+			/* The log epoch the sequence number belongs to. */
+			uint8_t epoch;
+		} _packed log_fetch;
+
 		/* RTC time. */
 		struct {
 			struct rtc_time time;
@@ -122,7 +174,55 @@ struct msg_payload {
 		/* Global controller state. */
 		struct {
 			uint8_t flags;
+			/* The supply voltage, in millivolts. */
+			uint16_t vcc_mv;
+			/* The temperature, in degree Celsius. */
+			int8_t temperature;
+			/* I2C error counters. */
+			struct twi_stats twi_stats;
+			/* Active notification LED events.
+			 * (Bitmask of enum notify_led_event) */
+			uint8_t notify_events;
 		} _packed contr_state;
+
+		/* Sensor configuration. */
+		struct {
+			uint8_t sensor_number;
+			struct sensor_config conf;
+			/* The current (auto-tuned) warmup time.
+			 * Read only. Ignored by the set-message. */
+			uint16_t tuned_warmup_ms;
+		} _packed sensor_conf;
+
+		/* Raw ADC stream samples. */
+		struct {
+			uint8_t count;
+			struct sensor_stream_sample samples[MSG_STREAM_MAX_SAMPLES];
+		} _packed sensor_stream;
+
+		/* Raw ADC stream control. */
+		struct {
+			uint8_t enable;
+			/* Bitmask of the streamed sensors. 0 = all. */
+			uint8_t sensor_mask;
+			/* Only stream every n-th conversion. */
+			uint8_t decimation;
+		} _packed sensor_stream_ctl;
+
+		/* Log filter configuration. */
+		struct {
+			struct log_config conf;
+		} _packed log_conf;
+
+		/* Valve I/O-extender error counters. */
+		struct {
+			struct ioext_stats stats;
+		} _packed ioext_stats;
+
+		/* Post-mortem info of the last reset. */
+		struct {
+			struct postmortem_info info;
+		} _packed reset_info;
 	} _packed;
 } _packed;
 
@@ -131,8 +231,58 @@ struct msg_payload {
 static jiffies_t jiffies_count;
 /* Serial communication timer. */
 static jiffies_t comm_timer;
-/* Timestamp for the next RTC time fetch. */
-static jiffies_t next_rtc_fetch;
+/* The host address raw ADC stream messages are sent to. */
+static uint8_t sensor_stream_addr;
+/* Log fetch burst state. */
+static struct {
+	/* More MSG_LOG messages have to be sent. */
+	bool active;
+	/* The host address the messages are sent to. */
+	uint8_t addr;
+	/* The sequence number of the next item to send. */
+	uint16_t seq;
+	/* The timestamp of the last sent item. */
+	timestamp_t base;
+} log_burst;
+
+
+/* Fill a MSG_LOG message with as many items as fit.
+ * seq: The sequence number of the first requested item.
+ * ack: Remove the items before 'seq'.
+ * chained: Encode relative to the previous message of the burst.
+ * Returns the number of items in the message.
+ */
+static uint8_t log_fill_message(struct msg_payload *pl, uint16_t seq,
+				bool ack, bool chained)
+{
+	uint8_t count, flags;
+
+	build_assert(LOG_COMPACT_MAXSIZE <= sizeof(pl->log.data));
+	build_assert(LOG_FETCH_MAX_ITEMS <= MSG_LOG_COUNT_MASK);
+
+	/* Only the first message pays for an absolute timestamp.
+	 * The following messages continue the delta encoding. */
+	if (!chained)
+		log_burst.base = 0;
+
+	pl->id = MSG_LOG;
+	count = log_fetch(pl->log.data, sizeof(pl->log.data),
+			  &seq, ack, &log_burst.base, &flags);
+	pl->log.seq = seq;
+	pl->log.count_flags = count | flags;
+	if (LOG_SUBSEC)
+		pl->log.count_flags |= MSG_LOG_SUBSEC;
+	if (chained)
+		pl->log.count_flags |= MSG_LOG_CHAINED;
+
+	/* Continue with a burst, until the log is empty. */
+	log_burst.seq = seq + count;
+	log_burst.active = count && log_burst.seq != log_end_seq();
+	if (log_burst.active)
+		pl->log.count_flags |= MSG_LOG_MORE;
+
+	return count;
+}
 
 
 /* Host message handler.
@@ -143,7 +293,6 @@ bool comm_handle_rx_message(const struct comm_message *msg,
 {
 	const struct msg_payload *pl = comm_payload(const struct msg_payload *, msg);
 	struct msg_payload *reply = reply_payload;
-	bool ok;
 
 	if (msg->fc & COMM_FC_ACK) {
 		/* This is just an acknowledge. Ignore. */
@@ -152,13 +301,26 @@ bool comm_handle_rx_message(const struct comm_message *msg,
 
 	switch (pl->id) {
 	case MSG_LOG_FETCH: {
-		/* Fetch of the first log item. */
+		/* Fetch of the oldest log items. */
+
+		log_burst.addr = comm_msg_sa(msg);
+		log_burst.active = 0;
+		if ((pl->log_fetch.flags & LOGFETCH_RESYNC) ||
+		    pl->log_fetch.epoch != log_get_epoch()) {
+			/* The sequence number is from another boot.
+			 * Do not acknowledge anything. Tell the host
+			 * the epoch and where the log starts. */
+			reply->id = MSG_LOG;
+			reply->log.count_flags = MSG_LOG_EPOCH;
+			reply->log.seq = log_start_seq();
+			reply->log.data[0] = log_get_epoch();
+			break;
+		}
 
-		/* Fill the reply message. */
-		reply->id = MSG_LOG;
-		/* Get the first item from the log stack. */
-		ok = log_pop(&reply->log.item);
-		if (!ok) {
+		/* Fill the reply message with as many items as fit.
+		 * This removes the items that the host received.
+		 * The remaining items follow in a burst. */
+		if (!log_fill_message(reply, pl->log_fetch.seq, 1, 0)) {
 			/* No log available.
 			 * Signal an error to the host. */
 			return 0;
@@ -307,8 +469,12 @@ bool comm_handle_rx_message(const struct comm_message *msg,
 		if (pl->manual_mode.flags & MANFLG_FREEZE_CHANGE)
 			controller_freeze(!!(pl->manual_mode.flags & MANFLG_FREEZE_ENABLE));
 
-		if (pl->manual_mode.flags & MANFLG_NOTIFY_CHANGE)
-			notify_led_set(!!(pl->manual_mode.flags & MANFLG_NOTIFY_ENABLE));
+		if (pl->manual_mode.flags & MANFLG_NOTIFY_CHANGE) {
+			if (pl->manual_mode.flags & MANFLG_NOTIFY_ENABLE)
+				notify_led_raise(NOTIFY_LED_HOST);
+			else
+				notify_led_clear();
+		}
 
 		break;
 	}
@@ -324,7 +490,86 @@ bool comm_handle_rx_message(const struct comm_message *msg,
 			reply->contr_state.flags |= CONTRSTAT_ONOFFSWITCH;
 		if (notify_led_get())
 			reply->contr_state.flags |= CONTRSTAT_NOTIFLED;
+		reply->contr_state.vcc_mv = sensor_get_vcc();
+		reply->contr_state.temperature = rv3029_get_temperature();
+		twi_get_stats(&reply->contr_state.twi_stats);
+		reply->contr_state.notify_events = notify_led_get_events();
+
+		break;
+	}
+	case MSG_SENSOR_CONF: {
+		/* Set sensor config. */
+
+		uint8_t sensor_number = pl->sensor_conf.sensor_number;
+
+		if (sensor_number >= SENSOR_COUNT) {
+			/* Invalid sensor number. */
+			return 0;
+		}
 
+		sensor_update_config(sensor_number, &pl->sensor_conf.conf);
+		break;
+	}
+	case MSG_SENSOR_CONF_FETCH: {
+		/* Fetch sensor config. */
+
+		uint8_t sensor_number = pl->sensor_conf.sensor_number;
+
+		if (sensor_number >= SENSOR_COUNT) {
+			/* Invalid sensor number. */
+			return 0;
+		}
+
+		/* Fill the reply message. */
+		reply->id = MSG_SENSOR_CONF;
+		reply->sensor_conf.sensor_number = sensor_number;
+		sensor_get_config(sensor_number, &reply->sensor_conf.conf);
+		reply->sensor_conf.tuned_warmup_ms = sensor_get_tuned_warmup(sensor_number);
+		break;
+	}
+	case MSG_SENSOR_STREAM_CTL: {
+		/* Enable/disable raw ADC streaming. */
+
+		if (!SENSOR_STREAM) {
+			/* Streaming support is not compiled in. */
+			return 0;
+		}
+
+		/* Stream to the host that requested it. */
+		sensor_stream_addr = comm_msg_sa(msg);
+		sensor_stream_enable(!!pl->sensor_stream_ctl.enable,
+				     pl->sensor_stream_ctl.sensor_mask,
+				     pl->sensor_stream_ctl.decimation);
+		break;
+	}
+	case MSG_LOG_CONF: {
+		/* Set log filter config. */
+
+		log_update_config(&pl->log_conf.conf);
+		break;
+	}
+	case MSG_LOG_CONF_FETCH: {
+		/* Fetch log filter config. */
+
+		/* Fill the reply message. */
+		reply->id = MSG_LOG_CONF;
+		log_get_config(&reply->log_conf.conf);
+		break;
+	}
+	case MSG_IOEXT_STATS_FETCH: {
+		/* Fetch the valve I/O-extender error counters. */
+
+		/* Fill the reply message. */
+		reply->id = MSG_IOEXT_STATS;
+		ioext_get_stats(&reply->ioext_stats.stats);
+		break;
+	}
+	case MSG_RESET_INFO_FETCH: {
+		/* Fetch post-mortem info of the last reset. */
+
+		/* Fill the reply message. */
+		reply->id = MSG_RESET_INFO;
+		reply->reset_info.info = *postmortem_get_info();
 		break;
 	}
 	default:
@@ -342,6 +587,10 @@ ISR(TIMER1_COMPA_vect)
 	/* Increment the system time counter. */
 	jiffies_count++;
 	mb();
+	/* Check the I2C transfer deadline. */
+	twi_systimer_tick();
+	/* Debounce the hardware on/off-switch. */
+	onoffswitch_systimer_tick();
 }
 
 /* Get the current system time counter. */
@@ -374,17 +623,45 @@ static void systimer_init(void)
 	TIMSK |= (1 << OCIE1A);
 }
 
-/* Handle realtime clock work. */
-static void handle_rtc(jiffies_t now)
+/* Send pending raw ADC stream samples to the host. */
+static void handle_sensor_stream(void)
 {
-	/* Only, if the RTC fetch timer expired. */
-	if (time_before(now, next_rtc_fetch))
+	COMM_MSG(msg);
+	struct msg_payload *pl = comm_payload(struct msg_payload *, &msg);
+	uint8_t count;
+
+	if (!sensor_stream_enabled())
 		return;
-	/* Re-trigger the RTC fetch timer. */
-	next_rtc_fetch = now + msec_to_jiffies(RTC_FETCH_INTERVAL_MS);
 
-	/* Read the current time from RTC. */
-	rv3029_read_time();
+	/* Keep one TX queue slot free for replies
+	 * and never block on a full TX queue. */
+	while (comm_tx_queue_free() >= 2) {
+		count = sensor_stream_pop(pl->sensor_stream.samples,
+					  MSG_STREAM_MAX_SAMPLES);
+		if (!count)
+			break;
+		pl->id = MSG_SENSOR_STREAM;
+		pl->sensor_stream.count = count;
+		comm_message_send(&msg, sensor_stream_addr);
+	}
+}
+
+/* Send the remaining MSG_LOG messages of a log fetch.
+ * The items are not removed. The host acknowledges them
+ * with its next fetch.
+ */
+static void handle_log_burst(void)
+{
+	COMM_MSG(msg);
+	struct msg_payload *pl = comm_payload(struct msg_payload *, &msg);
+
+	/* Keep one TX queue slot free for replies
+	 * and never block on a full TX queue. */
+	while (log_burst.active && comm_tx_queue_free() >= 2) {
+		if (!log_fill_message(pl, log_burst.seq, 0, 1))
+			break;
+		comm_message_send(&msg, log_burst.addr);
+	}
 }
 
 /* Handle changes on the hardware on/off-switch state. */
@@ -399,7 +676,7 @@ static enum onoff_state handle_onoffswitch(void)
 	    hw_switch == ONOFF_SWITCHED_OFF) {
 		/* The controller is off.
 		 * Enable notification LED permanently. */
-		notify_led_set(1);
+		notify_led_raise(NOTIFY_LED_HWOFF);
 	}
 
 	if (hw_switch == ONOFF_SWITCHED_OFF) {
@@ -412,7 +689,7 @@ static enum onoff_state handle_onoffswitch(void)
 		/* Disable notification LED.
 		 * This will also clear notification messages from other
 		 * sources (e.g. controller). */
-		notify_led_set(0);
+		notify_led_clear();
 	}
 
 	return hw_switch;
@@ -426,6 +703,9 @@ int main(void)
 
 	irq_disable();
 
+	/* Fetch the reset cause before anything else. */
+	postmortem_init();
+
 	wdt_enable(WDTO_2S);
 
 	/* Initialize the system. */
@@ -434,6 +714,8 @@ int main(void)
 	twi_init();
 	systimer_init();
 	rv3029_init();
+	log_setup();
+	postmortem_log();
 	sensor_init();
 	controller_init();
 	comm_init();
@@ -452,22 +734,39 @@ int main(void)
 		now = jiffies_get();
 
 		/* Handle the state of the hardware on/off-switch. */
+		postmortem_phase(PM_PHASE_ONOFFSWITCH);
 		handle_onoffswitch();
 
 		/* Handle serial host communication. */
+		postmortem_phase(PM_PHASE_COMM);
 		comm_work();
 		if (!time_before(now, comm_timer)) {
 			comm_timer = now + msec_to_jiffies(10);
 			comm_centisecond_tick();
 		}
+		handle_sensor_stream();
+		handle_log_burst();
 
-		/* Handle realtime clock work. */
-		handle_rtc(now);
+		/* Handle log background work. */
+		postmortem_phase(PM_PHASE_LOG);
+		log_work();
+
+		/* Handle TWI bus recovery and realtime clock work. */
+		postmortem_phase(PM_PHASE_RTC);
+		twi_work();
+		rv3029_work();
 
 		/* Run the controller state machine. */
+		postmortem_phase(PM_PHASE_CONTROLLER);
 		controller_work();
+		postmortem_update_pots();
+
+		/* Flush the valve outputs. */
+		postmortem_phase(PM_PHASE_IOEXT);
+		ioext_work();
 
 		/* Handle notification LED state. */
+		postmortem_phase(PM_PHASE_NOTIFYLED);
 		notify_led_work();
 	}
 }
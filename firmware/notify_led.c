@@ -31,77 +31,160 @@
 #define NOTIFY_LED_PORT		PORTD
 #define NOTIFY_LED_BIT		4
 
-#define PULSE_PAUSE_TIME	msec_to_jiffies(50)
-#define LONG_PAUSE_TIME		msec_to_jiffies(3000)
-
+/* Duration of one pattern bit. */
+#define SLOT_TIME		msec_to_jiffies(200)
+/* Pause between two patterns. */
+#define LONG_PAUSE_TIME		msec_to_jiffies(2000)
+
+/* Number of bits in a pattern. */
+#define NR_SLOTS		8
+
+
+/* Blink patterns. One bit per SLOT_TIME, MSB first. 1 = LED on. */
+static const uint8_t PROGMEM notify_led_patterns[NOTIFY_LED_NR_EVENTS] = {
+	[NOTIFY_LED_WATERDOG]	= 0xA0,	/* 2 short */
+	[NOTIFY_LED_IOEXT]	= 0xA8,	/* 3 short */
+	[NOTIFY_LED_SENSOR]	= 0xAA,	/* 4 short */
+	[NOTIFY_LED_FREEZE]	= 0xE8,	/* 1 long, 1 short */
+	[NOTIFY_LED_RTC]	= 0xEA,	/* 1 long, 2 short */
+	[NOTIFY_LED_HWOFF]	= 0xFF,	/* 1 very long */
+	[NOTIFY_LED_HOST]	= 0xEE,	/* 2 long */
+};
 
 struct notify_led {
-	bool state;
-	uint8_t count;
+	/* Bitmask of active events. */
+	uint8_t events;
+	/* The event that is currently shown. */
+	uint8_t current;
+	/* The next pattern bit. NR_SLOTS is the pause. */
+	uint8_t slot;
 	jiffies_t timer;
+	/* The events have to be written to the EEPROM. */
+	bool persist_pending;
 };
 
 static struct notify_led led;
 
-static uint8_t EEMEM eeprom_notify_led_state = 0;
+static uint8_t EEMEM eeprom_notify_led_events = 0;
 
 
-void notify_led_set(bool on)
+static void notify_led_port(bool on)
 {
 	uint8_t sreg;
 
 	sreg = irq_disable_save();
+	if (on)
+		NOTIFY_LED_PORT |= (1 << NOTIFY_LED_BIT);
+	else
+		NOTIFY_LED_PORT &= ~(1 << NOTIFY_LED_BIT);
+	irq_restore(sreg);
+}
 
-	if (led.state != on) {
-		led.count = 0;
-		led.state = on;
-		led.timer = jiffies_get() + PULSE_PAUSE_TIME;
+static void notify_led_update_events(uint8_t events)
+{
+	if (events == led.events)
+		return;
+
+	if (!led.events) {
+		/* Start showing the patterns right away. */
+		led.current = 0;
+		led.slot = 0;
+		led.timer = jiffies_get();
+	}
+	led.events = events;
+	if (!events)
+		notify_led_port(0);
 
-		if (on)
-			NOTIFY_LED_PORT |= (1 << NOTIFY_LED_BIT);
-		else
-			NOTIFY_LED_PORT &= ~(1 << NOTIFY_LED_BIT);
+	/* The EEPROM is written by notify_led_work(). */
+	led.persist_pending = 1;
+}
 
-		eeprom_update_byte(&eeprom_notify_led_state, on);
-	}
+/* Activate a notification event. */
+void notify_led_raise(enum notify_led_event event)
+{
+	notify_led_update_events(led.events | BITMASK8(event));
+}
 
-	irq_restore(sreg);
+/* Deactivate all notification events. */
+void notify_led_clear(void)
+{
+	notify_led_update_events(0);
 }
 
+/* Returns true, if any notification is active. */
 bool notify_led_get(void)
 {
-	return led.state;
+	return led.events != 0;
+}
+
+/* Get the bitmask of active notification events. */
+uint8_t notify_led_get_events(void)
+{
+	return led.events;
+}
+
+/* Write the active events to the EEPROM, if they changed.
+ * This never waits for the EEPROM.
+ */
+static void notify_led_persist(void)
+{
+	uint8_t events;
+
+	if (!led.persist_pending || !eeprom_is_ready())
+		return;
+	led.persist_pending = 0;
+
+	events = led.events;
+	if (eeprom_read_byte(&eeprom_notify_led_events) != events)
+		eeprom_write_byte(&eeprom_notify_led_events, events);
+}
+
+/* Find the active event with the highest priority,
+ * starting at 'event'. Wraps around to the highest priority.
+ */
+static uint8_t notify_led_next_event(uint8_t event)
+{
+	uint8_t i;
+
+	for (i = 0; i < NOTIFY_LED_NR_EVENTS; i++) {
+		if (event >= NOTIFY_LED_NR_EVENTS)
+			event = 0;
+		if (led.events & BITMASK8(event))
+			break;
+		event++;
+	}
+
+	return event;
 }
 
 void notify_led_work(void)
 {
 	jiffies_t now = jiffies_get();
-	uint8_t sreg;
+	uint8_t pattern;
 
-	sreg = irq_disable_save();
+	notify_led_persist();
 
-	if (led.state && !time_before(now, led.timer)) {
-		switch (led.count) {
-		default:
-			led.count = -1;
-			/* fallthrough */
-		case 0:
-		case 1:
-		case 2:
-		case 3:
-			led.count++;
-			led.timer = now + PULSE_PAUSE_TIME;
-			NOTIFY_LED_PORT ^= (1 << NOTIFY_LED_BIT);
-			break;
-		case 4:
-			led.count++;
-			led.timer = now + LONG_PAUSE_TIME;
-			NOTIFY_LED_PORT &= ~(1 << NOTIFY_LED_BIT);
-			break;
-		}
+	if (!led.events || time_before(now, led.timer))
+		return;
+
+	if (led.slot == 0) {
+		/* Show the pending events in priority order. */
+		led.current = notify_led_next_event(led.current);
 	}
 
-	irq_restore(sreg);
+	if (led.slot >= NR_SLOTS) {
+		/* Pause. Then show the next event. */
+		notify_led_port(0);
+		led.timer = now + LONG_PAUSE_TIME;
+		led.slot = 0;
+		led.current++;
+		return;
+	}
+
+	pattern = pgm_read_byte(&notify_led_patterns[led.current]);
+	notify_led_port(!!(pattern & BITMASK8(NR_SLOTS - 1 - led.slot)));
+	led.timer = now + SLOT_TIME;
+	led.slot++;
 }
 
 void notify_led_init(void)
@@ -109,6 +192,9 @@ void notify_led_init(void)
 	NOTIFY_LED_PORT &= ~(1 << NOTIFY_LED_BIT);
 	NOTIFY_LED_DDR |= (1 << NOTIFY_LED_BIT);
 
+	build_assert(NOTIFY_LED_NR_EVENTS <= 8);
+
 	memset(&led, 0, sizeof(led));
-	led.state = eeprom_read_byte(&eeprom_notify_led_state);
+	led.events = eeprom_read_byte(&eeprom_notify_led_events);
+	led.events &= (uint8_t)(BITMASK8(NOTIFY_LED_NR_EVENTS) - 1);
 }
@@ -4,8 +4,25 @@
 #include "util.h"
 
 
-void notify_led_set(bool on);
+/* Notification events, in priority order. Highest priority first.
+ * Each event has its own blink pattern.
+ */
+enum notify_led_event {
+	NOTIFY_LED_WATERDOG,		/* Watering-watchdog fired. */
+	NOTIFY_LED_IOEXT,		/* Valve output read-back mismatch. */
+	NOTIFY_LED_SENSOR,		/* Sensor short circuit. */
+	NOTIFY_LED_FREEZE,		/* Freeze timeout. */
+	NOTIFY_LED_RTC,			/* RTC EEPROM write failed. */
+	NOTIFY_LED_HWOFF,		/* Hardware on/off-switch is off. */
+	NOTIFY_LED_HOST,		/* Enabled by the host. */
+
+	NOTIFY_LED_NR_EVENTS,
+};
+
+void notify_led_raise(enum notify_led_event event);
+void notify_led_clear(void);
 bool notify_led_get(void);
+uint8_t notify_led_get_events(void);
 
 void notify_led_work(void);
 void notify_led_init(void);
@@ -31,39 +31,53 @@
 #define ONOFFSWITCH_PIN			PIND
 #define ONOFFSWITCH_BIT			PD3
 
+/* The switch must be stable for this time, in milliseconds,
+ * before a new level is accepted. */
+#define ONOFFSWITCH_DEBOUNCE_MS		30
+
+/* Debounced edges, latched by the system timer tick. */
+enum onoffswitch_edges {
+	ONOFFSWITCH_EDGE_ON	= 1 << 0,	/* Switched on. */
+	ONOFFSWITCH_EDGE_OFF	= 1 << 1,	/* Switched off. */
+};
+
 /* Saved state. */
 static enum onoff_state onoffswitch_state = ONOFF_IS_OFF;
-/* Timestamp for the next check. */
-static jiffies_t next_check;
+/* The debounced level. 1 = on. */
+static bool debounced_level;
+/* Number of ticks the pin differed from the debounced level. */
+static uint8_t debounce_count;
+/* The debounced edges, not yet consumed by onoffswitch_work().
+ * (enum onoffswitch_edges) */
+static uint8_t pending_edges;
 
 
-static void onoffswitch_eliminate_edge_states(void)
+/* Read the switch level from the pin. Returns 1, if on. */
+static bool onoffswitch_read(void)
 {
-	if (onoffswitch_state == ONOFF_SWITCHED_ON)
-		onoffswitch_state = ONOFF_IS_ON;
-	else if (onoffswitch_state == ONOFF_SWITCHED_OFF)
-		onoffswitch_state = ONOFF_IS_OFF;
+	/* Switch logic is inverted. */
+	return !(ONOFFSWITCH_PIN & (1 << ONOFFSWITCH_BIT));
 }
 
-static void onoffswitch_update(void)
+/* Must be called on every system timer tick.
+ * Debounces the switch and latches the debounced edges.
+ */
+void onoffswitch_systimer_tick(void)
 {
-	bool new_state, old_state;
+	bool level = onoffswitch_read();
 
-	/* Get the state. */
-	new_state = !!(ONOFFSWITCH_PIN & (1 << ONOFFSWITCH_BIT));
-	/* Switch logic is inverted. */
-	new_state = !new_state;
-
-	/* Detect state and edges. */
-	old_state = (onoffswitch_state != ONOFF_IS_OFF);
-	if (new_state && !old_state)
-		onoffswitch_state = ONOFF_SWITCHED_ON;
-	else if (!new_state && old_state)
-		onoffswitch_state = ONOFF_SWITCHED_OFF;
-	else if (new_state)
-		onoffswitch_state = ONOFF_IS_ON;
-	else
-		onoffswitch_state = ONOFF_IS_OFF;
+	if (level == debounced_level) {
+		/* Bounce restarts the debounce time. */
+		debounce_count = 0;
+		return;
+	}
+	if (++debounce_count < msec_to_jiffies(ONOFFSWITCH_DEBOUNCE_MS))
+		return;
+
+	/* The new level was stable for the debounce time. */
+	debounce_count = 0;
+	debounced_level = level;
+	pending_edges |= level ? ONOFFSWITCH_EDGE_ON : ONOFFSWITCH_EDGE_OFF;
 }
 
 /* Initialize the on/off-switch. */
@@ -72,21 +86,43 @@ void onoffswitch_init(void)
 	ONOFFSWITCH_DDR &= ~(1 << ONOFFSWITCH_BIT);
 	ONOFFSWITCH_PORT |= (1 << ONOFFSWITCH_BIT);
 	_delay_ms(20); /* Wait for pull-up. */
-	onoffswitch_update();
-	onoffswitch_eliminate_edge_states();
+
+	debounced_level = onoffswitch_read();
+	onoffswitch_state = debounced_level ? ONOFF_IS_ON : ONOFF_IS_OFF;
 }
 
-/* Periodic work. */
+/* Periodic work.
+ * Consumes one latched edge per call, so that every
+ * transition is seen by the mainloop.
+ */
 void onoffswitch_work(void)
 {
-	jiffies_t now = jiffies_get();
+	bool level;
+	uint8_t sreg;
 
-	onoffswitch_eliminate_edge_states();
-
-	if (!time_before(now, next_check)) {
-		next_check = now + msec_to_jiffies(100);
-		onoffswitch_update();
+	sreg = irq_disable_save();
+	level = debounced_level;
+	if (onoffswitch_state == ONOFF_IS_OFF ||
+	    onoffswitch_state == ONOFF_SWITCHED_OFF) {
+		if (pending_edges & ONOFFSWITCH_EDGE_ON) {
+			pending_edges &= (uint8_t)~ONOFFSWITCH_EDGE_ON;
+			level = 1;
+		}
+	} else {
+		if (pending_edges & ONOFFSWITCH_EDGE_OFF) {
+			pending_edges &= (uint8_t)~ONOFFSWITCH_EDGE_OFF;
+			level = 0;
+		}
 	}
+	irq_restore(sreg);
+
+	/* Detect state and edges. More than two edges between two
+	 * calls collapse into one edge of each direction. */
+	if (onoffswitch_state == ONOFF_IS_OFF ||
+	    onoffswitch_state == ONOFF_SWITCHED_OFF)
+		onoffswitch_state = level ? ONOFF_SWITCHED_ON : ONOFF_IS_OFF;
+	else
+		onoffswitch_state = level ? ONOFF_IS_ON : ONOFF_SWITCHED_OFF;
 }
 
 /* Get the on/off-switch state. */
@@ -9,6 +9,7 @@ enum onoff_state {
 };
 
 void onoffswitch_init(void);
+void onoffswitch_systimer_tick(void);
 void onoffswitch_work(void);
 enum onoff_state onoffswitch_get_state();
 
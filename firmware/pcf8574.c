@@ -50,36 +50,84 @@ void pcf8574_write(struct pcf8574_chip *chip,
 	/* Wait for previous transfer to finish, if any. */
 	pcf8574_wait(chip);
 
-	/* Prepare the I2C transfer context. */
-	chip->xfer.buffer = &write_value;
-	chip->xfer.write_size = sizeof(write_value);
+	/* Prepare the I2C transfer context.
+	 * The buffer must stay valid until the transfer finished. */
+	chip->buffer = write_value;
+	chip->xfer.write_size = sizeof(chip->buffer);
 	chip->xfer.read_size = 0;
 
 	/* Trigger the I2C transfer. */
 	twi_transfer(&chip->xfer);
 }
 
-/* Synchronously read the input states of a PCF-8574 chip.
+/* Get the status of the scheduled transfer.
  * chip: The PCF-8574 chip instance.
- * Returns the 8-bit chip-input value.
  */
-uint8_t pcf8574_read(struct pcf8574_chip *chip)
+enum twi_status pcf8574_get_status(struct pcf8574_chip *chip)
 {
-	uint8_t read_value;
+	return twi_transfer_get_status(&chip->xfer);
+}
 
+/* Asynchronously read the input states of a PCF-8574 chip.
+ * The value is available via pcf8574_get_value(),
+ * after the transfer finished.
+ * chip: The PCF-8574 chip instance.
+ */
+void pcf8574_read_async(struct pcf8574_chip *chip)
+{
 	/* Wait for previous transfer to finish, if any. */
 	pcf8574_wait(chip);
 
 	/* Prepare the I2C transfer context. */
-	chip->xfer.buffer = &read_value;
 	chip->xfer.write_size = 0;
-	chip->xfer.read_size = sizeof(read_value);
+	chip->xfer.read_size = sizeof(chip->buffer);
 
-	/* Trigger the I2C transfer and wait for it to finish. */
+	/* Trigger the I2C transfer. */
 	twi_transfer(&chip->xfer);
+}
+
+/* Get the value of the last finished read.
+ * chip: The PCF-8574 chip instance.
+ */
+uint8_t pcf8574_get_value(struct pcf8574_chip *chip)
+{
+	return chip->buffer;
+}
+
+/* Asynchronously write the output states and read the input states
+ * of a PCF-8574 chip in one transfer.
+ * This function first writes and then reads.
+ * The read value is available via pcf8574_get_value(),
+ * after the transfer finished.
+ * chip: The PCF-8574 chip instance.
+ * write_value: The 8-bit value to write.
+ */
+void pcf8574_write_read_async(struct pcf8574_chip *chip,
+			      uint8_t write_value)
+{
+	/* Wait for previous transfer to finish, if any. */
 	pcf8574_wait(chip);
 
-	return read_value;
+	/* Prepare the I2C transfer context. */
+	chip->buffer = write_value;
+	chip->xfer.write_size = sizeof(chip->buffer);
+	chip->xfer.read_size = sizeof(chip->buffer);
+
+	/* Trigger the I2C transfer. */
+	twi_transfer(&chip->xfer);
+}
+
+/* Synchronously read the input states of a PCF-8574 chip.
+ * chip: The PCF-8574 chip instance.
+ * Returns the 8-bit chip-input value.
+ */
+uint8_t pcf8574_read(struct pcf8574_chip *chip)
+{
+	/* Trigger the I2C transfer and wait for it to finish. */
+	pcf8574_read_async(chip);
+	pcf8574_wait(chip);
+
+	return chip->buffer;
 }
 
 /* Synchronously write the output states and read the input states
@@ -92,21 +140,11 @@ uint8_t pcf8574_read(struct pcf8574_chip *chip)
 uint8_t pcf8574_write_read(struct pcf8574_chip *chip,
 			   uint8_t write_value)
 {
-	uint8_t buffer = write_value;
-
-	/* Wait for previous transfer to finish, if any. */
-	pcf8574_wait(chip);
-
-	/* Prepare the I2C transfer context. */
-	chip->xfer.buffer = &buffer;
-	chip->xfer.write_size = sizeof(buffer);
-	chip->xfer.read_size = sizeof(buffer);
-
 	/* Trigger the I2C transfer and wait for it to finish. */
-	twi_transfer(&chip->xfer);
+	pcf8574_write_read_async(chip, write_value);
 	pcf8574_wait(chip);
 
-	return buffer;
+	return chip->buffer;
 }
 
 /* Initialize a PCF-8574 context structure.
@@ -123,6 +161,9 @@ void pcf8574_init(struct pcf8574_chip *chip,
 {
 	/* Initialize the I2C transfer structure. */
 	twi_transfer_init(&chip->xfer);
+	chip->xfer.buffer = &chip->buffer;
+	/* The PCF-8574 is specified for 100 kHz only. */
+	chip->xfer.speed = TWI_SPEED_STD;
 
 	/* Calculate the I2C address, based on the
 	 * Chip version and the sub-address. */
@@ -11,6 +11,8 @@
 struct pcf8574_chip {
 	/* I2C transfer context. */
 	struct twi_transfer xfer;
+	/* I2C transfer data buffer. */
+	uint8_t buffer;
 };
 
 void pcf8574_init(struct pcf8574_chip *chip,
@@ -20,6 +22,12 @@ void pcf8574_init(struct pcf8574_chip *chip,
 void pcf8574_write(struct pcf8574_chip *chip,
 		   uint8_t write_value);
 void pcf8574_wait(struct pcf8574_chip *chip);
+enum twi_status pcf8574_get_status(struct pcf8574_chip *chip);
+
+void pcf8574_read_async(struct pcf8574_chip *chip);
+void pcf8574_write_read_async(struct pcf8574_chip *chip,
+			      uint8_t write_value);
+uint8_t pcf8574_get_value(struct pcf8574_chip *chip);
 
 uint8_t pcf8574_read(struct pcf8574_chip *chip);
 
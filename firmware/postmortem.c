@@ -0,0 +1,116 @@
+/*
+ * Reset cause and post-mortem snapshot
+ *
+ * Copyright (c) 2014 Michael Buesch <m@bues.ch>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "postmortem.h"
+#include "log.h"
+
+#include <avr/io.h>
+
+#include <string.h>
+
+
+#define POSTMORTEM_MAGIC	0x504D
+
+/* The MCUCSR reset flags. */
+#define RESET_FLAGS_MASK	((1 << WDRF) | (1 << BORF) | \
+				 (1 << EXTRF) | (1 << PORF))
+
+
+/* The snapshot is not cleared by the C runtime on reset. */
+struct postmortem_snapshot postmortem_snap __attribute__((__section__(".noinit")));
+/* Information about the previous reset. */
+static struct postmortem_info postmortem_info;
+
+
+/* Copy the pot states into the snapshot.
+ * Called once per mainloop pass.
+ */
+void postmortem_update_pots(void)
+{
+	struct flowerpot_state state;
+	uint8_t i;
+
+	for (i = 0; i < MAX_NR_FLOWERPOTS; i++) {
+		controller_get_pot_state(i, &state, NULL);
+		postmortem_snap.pot_states[i] =
+			(uint8_t)((state.state_id & 0x7F) |
+				  (state.is_watering ? 0x80 : 0));
+	}
+}
+
+/* Record a software reboot. Called by reboot(). */
+void postmortem_reboot(void)
+{
+	if (postmortem_snap.phase != PM_PHASE_PANIC)
+		postmortem_snap.phase = PM_PHASE_REBOOT;
+}
+
+/* Record a panic. Called by panic().
+ * pc: The address of the panic() caller.
+ */
+void postmortem_panic(uint16_t pc)
+{
+	postmortem_snap.phase = PM_PHASE_PANIC;
+	postmortem_snap.pc = pc;
+}
+
+/* Get the information about the previous reset. */
+const struct postmortem_info * postmortem_get_info(void)
+{
+	return &postmortem_info;
+}
+
+/* Log the cause of the previous reset.
+ * Must be called after log_setup().
+ */
+void postmortem_log(void)
+{
+	struct postmortem_info *info = &postmortem_info;
+
+	log_info(LOG_INFO_RESET, LOG_RESET(info->phase, info->reset_flags));
+}
+
+/* Fetch and clear the reset cause and take over the snapshot
+ * of the previous run. Must be called first on boot.
+ */
+void postmortem_init(void)
+{
+	struct postmortem_info *info = &postmortem_info;
+	struct postmortem_snapshot *snap = &postmortem_snap;
+
+	memset(info, 0, sizeof(*info));
+	info->reset_flags = MCUCSR & RESET_FLAGS_MASK;
+	MCUCSR = 0;
+
+	/* The RAM content is undefined after power-on. */
+	if (snap->magic == POSTMORTEM_MAGIC &&
+	    !(info->reset_flags & (1 << PORF))) {
+		info->phase = snap->phase;
+		info->pc = snap->pc;
+		memcpy(info->pot_states, snap->pot_states,
+		       sizeof(info->pot_states));
+	} else
+		info->phase = PM_PHASE_UNKNOWN;
+
+	/* Start a new snapshot. */
+	memset(snap, 0, sizeof(*snap));
+	snap->magic = POSTMORTEM_MAGIC;
+	snap->phase = PM_PHASE_INIT;
+}
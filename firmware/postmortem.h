@@ -0,0 +1,69 @@
+#ifndef POSTMORTEM_H_
+#define POSTMORTEM_H_
+
+#include "util.h"
+#include "controller.h"
+
+
+/* Mainloop phases, recorded for post-mortem analysis.
+ * Must be smaller than 16 to fit into the LOG_INFO_RESET item.
+ */
+enum postmortem_phase {
+	PM_PHASE_INIT,			/* System initialization. */
+	PM_PHASE_ONOFFSWITCH,		/* On/off-switch handling. */
+	PM_PHASE_COMM,			/* Host communication. */
+	PM_PHASE_LOG,			/* Log background work. */
+	PM_PHASE_RTC,			/* Realtime clock work. */
+	PM_PHASE_CONTROLLER,		/* Controller state machine. */
+	PM_PHASE_IOEXT,			/* Valve output flush. */
+	PM_PHASE_NOTIFYLED,		/* Notification LED. */
+	PM_PHASE_REBOOT,		/* reboot() was called. */
+	PM_PHASE_PANIC,			/* panic() was called. */
+
+	PM_PHASE_UNKNOWN	= 0xF,	/* No valid snapshot. */
+};
+
+/* Snapshot of the running system.
+ * This lives in the .noinit section and survives resets.
+ */
+struct postmortem_snapshot {
+	/* POSTMORTEM_MAGIC, if the snapshot is valid. */
+	uint16_t magic;
+	/* The current phase. (enum postmortem_phase) */
+	uint8_t phase;
+	/* The caller of panic(). 0, if panic() was not called. */
+	uint16_t pc;
+	/* The pot states. Bit 7: Watering. Bits 0-6: State-ID. */
+	uint8_t pot_states[MAX_NR_FLOWERPOTS];
+};
+
+/* Post-mortem information about the previous reset. */
+struct postmortem_info {
+	/* The MCUCSR reset flags. */
+	uint8_t reset_flags;
+	/* The phase at the time of the reset. (enum postmortem_phase) */
+	uint8_t phase;
+	/* The caller of panic(). 0, if panic() was not called. */
+	uint16_t pc;
+	/* The pot states at the time of the reset. */
+	uint8_t pot_states[MAX_NR_FLOWERPOTS];
+} _packed;
+
+extern struct postmortem_snapshot postmortem_snap;
+
+/* Record the current mainloop phase. */
+static inline void postmortem_phase(enum postmortem_phase phase)
+{
+	postmortem_snap.phase = phase;
+}
+
+void postmortem_update_pots(void);
+void postmortem_reboot(void);
+void postmortem_panic(uint16_t pc);
+
+const struct postmortem_info * postmortem_get_info(void);
+
+void postmortem_log(void);
+void postmortem_init(void);
+
+#endif /* POSTMORTEM_H_ */
@@ -21,9 +21,23 @@
 #include "rv3029.h"
 #include "datetime.h"
 #include "twi_master.h"
+#include "main.h"
+#include "log.h"
+#include "notify_led.h"
 
 #include <string.h>
 
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+
+/* Bus clock of the RV-3029 transfers. */
+#if RV3029_TWI_FAST
+# define RV3029_TWI_SPEED	TWI_SPEED_FAST
+#else
+# define RV3029_TWI_SPEED	TWI_SPEED_STD
+#endif
+
 
 /* RV-3029 hardware registers */
 enum rv3029_registers {
@@ -178,15 +192,87 @@ enum rv3029_bits_eectrl {
 	RV3029_EECTRL_R80K,
 };
 
+/* RV-3029 EEPROM write state machine states. */
+enum rv3029_ee_state {
+	RV3029_EE_IDLE,		/* No EEPROM write running. */
+	RV3029_EE_VLOW,		/* Checking the voltage low flags. */
+	RV3029_EE_CLRVLOW,	/* Clearing the voltage low flags. */
+	RV3029_EE_SETTLE,	/* Waiting for the supply voltage to settle. */
+	RV3029_EE_ONOFF,	/* Reading the on/off control register. */
+	RV3029_EE_REFOFF,	/* Clearing the EEPROM refresh bit. */
+	RV3029_EE_BUSY1,	/* Waiting for the EEPROM to become ready. */
+	RV3029_EE_READ,		/* Reading the old EEPROM value. */
+	RV3029_EE_WRITE,	/* Writing the new EEPROM value. */
+	RV3029_EE_BUSY2,	/* Waiting for the EEPROM write to finish. */
+	RV3029_EE_RESTORE,	/* Restoring the on/off control register. */
+};
+
 /* RV-3029 device state. */
 struct rv3029_device {
 	/* I2C transfer context. */
 	struct twi_transfer xfer;
 	/* I2C transfer data buffer. */
 	uint8_t xfer_buffer[8];
+	/* I2C transfer segments for register writes. */
+	struct twi_segment xfer_segments[2];
 
-	/* Cached watch time. */
+	/* Cached watch time. This is the software clock. */
 	struct rtc_time now;
+	/* Jiffies timestamp of the start of the current second
+	 * of the cached watch time.
+	 */
+	jiffies_t now_jiffies;
+	/* Number of jiffies the current second is stretched by.
+	 * This slows the software clock down, if it runs ahead.
+	 */
+	jiffies_t slew;
+	/* Timestamp for the next resynchronisation from the hardware. */
+	jiffies_t next_resync;
+
+	/* The start of the current second is aligned to the RTC. */
+	bool aligned;
+	/* The seconds of the previous alignment read.
+	 * RV3029_NO_SECOND, if there was none. */
+	uint8_t align_second;
+	/* Jiffies timestamp of the previous alignment read. */
+	jiffies_t align_jiffies;
+
+	/* I2C transfer context for the temperature read and
+	 * the EEPROM state machine. The temperature is not read
+	 * while the EEPROM state machine runs.
+	 */
+	struct twi_transfer aux_xfer;
+	/* Register address and data buffer of aux_xfer. */
+	uint8_t aux_buffer[2];
+	/* Cached temperature, in degree Celsius. */
+	int8_t temp;
+
+	/* EEPROM state machine state. */
+	enum rv3029_ee_state ee_state;
+	/* The EEPROM register and the value to write to it. */
+	uint8_t ee_reg;
+	uint8_t ee_value;
+	/* The saved on/off control register. */
+	uint8_t ee_onoffctrl;
+	/* Timeout of the running EEPROM write. */
+	jiffies_t ee_timeout;
+	/* End of the supply voltage settle time. */
+	jiffies_t ee_settle;
+
+#if RV3029_IRQ
+	/* I2C transfer context for clearing the interrupt flags. */
+	struct twi_transfer irq_xfer;
+	/* Interrupt flags register address and value. */
+	uint8_t irq_buffer[2];
+	/* Set by the INT0 interrupt handler. */
+	volatile bool irq_pending;
+	/* Jiffies timestamp of the last interrupt. */
+	jiffies_t irq_jiffies;
+	/* The running resynchronisation was triggered by the interrupt.
+	 * Set when the read is scheduled, cleared by its callback.
+	 */
+	bool irq_sync;
+#endif
 };
 
 /* Instance of the device state. */
@@ -197,17 +283,42 @@ static struct rv3029_device rv3029_dev;
 #define RV3029_I2C_ADDRESS	0x56
 /* I2C transfer timeout, in milliseconds. */
 #define RV3029_I2C_TIMEOUT	50
+/* Timeout of a complete EEPROM write, in milliseconds. */
+#define RV3029_EE_TIMEOUT_MS	1000
+
+/* Invalid value of the seconds register. */
+#define RV3029_NO_SECOND	0xFF
+
+/* Offset of the temperature register value, in degree Celsius. */
+#define RV3029_TEMP_OFFSET	60
+
+/* Interval between resynchronisations of the software clock
+ * from the hardware, in seconds.
+ * With the interrupt this only is a fallback for a lost interrupt.
+ */
+#if RV3029_IRQ
+# define RV3029_RESYNC_SEC	600
+#else
+# define RV3029_RESYNC_SEC	60
+#endif
+
+/* Port definitions for the RV-3029 /INT output. */
+#define RV3029_IRQ_DDR		DDRD
+#define RV3029_IRQ_PORT		PORTD
+#define RV3029_IRQ_BIT		PD2
 
 
 /* Schedule an asynchronous multi-byte register write.
+ * The register offset and the payload are sent as two segments
+ * of one transfer, so the payload is not copied.
  * reg: The hardware register to start writing to.
- * buffer: The data buffer.
+ * buffer: The data buffer. Must stay valid until the transfer finished.
  * count: The number of bytes to write.
  * callback: The callback to call on completion or error.
  *           May be NULL.
  */
 static void rv3029_write_async(uint8_t reg,
-			       const void *buffer, uint8_t count,
+			       void *buffer, uint8_t count,
 			       twi_callback_t callback)
 {
 	struct rv3029_device *dev = &rv3029_dev;
@@ -215,15 +326,20 @@ static void rv3029_write_async(uint8_t reg,
 	/* Wait for a possible previous transfer to finish. */
 	twi_transfer_wait(&dev->xfer, RV3029_I2C_TIMEOUT);
 
-	count = min(count, sizeof(dev->xfer_buffer) - 1);
-
-	/* The first byte is the register offset. */
+	/* The first segment is the register offset. */
 	dev->xfer_buffer[0] = reg;
-	/* Append the payload data. */
-	memcpy(dev->xfer_buffer + 1, buffer, count);
-
-	dev->xfer.write_size = count + 1;
-	dev->xfer.read_size = 0;
+	dev->xfer_segments[0].buffer = dev->xfer_buffer;
+	dev->xfer_segments[0].size = 1;
+	dev->xfer_segments[0].address = RV3029_I2C_ADDRESS;
+	dev->xfer_segments[0].flags = 0;
+	/* The second segment is the payload data. */
+	dev->xfer_segments[1].buffer = buffer;
+	dev->xfer_segments[1].size = count;
+	dev->xfer_segments[1].address = RV3029_I2C_ADDRESS;
+	dev->xfer_segments[1].flags = TWI_SEG_NOSTART;
+
+	dev->xfer.segments = dev->xfer_segments;
+	dev->xfer.nr_segments = ARRAY_SIZE(dev->xfer_segments);
 	dev->xfer.callback = callback;
 
 	/* Schedule the I2C transfer. */
@@ -237,7 +353,7 @@ static void rv3029_write_async(uint8_t reg,
  * Returns 1 on success, or 0 on I2C error.
  */
 static bool rv3029_write(uint8_t reg,
-			 const void *buffer, uint8_t count)
+			 void *buffer, uint8_t count)
 {
 	struct rv3029_device *dev = &rv3029_dev;
 	enum twi_status stat;
@@ -280,6 +396,7 @@ static void rv3029_read_async(uint8_t reg, uint8_t count,
 	/* Write the register offset (one byte). */
 	dev->xfer_buffer[0] = reg;
 
+	dev->xfer.nr_segments = 0;
 	dev->xfer.write_size = 1;
 	dev->xfer.read_size = count;
 	dev->xfer.callback = callback;
@@ -288,90 +405,185 @@ static void rv3029_read_async(uint8_t reg, uint8_t count,
 	twi_transfer(&dev->xfer);
 }
 
-/* Synchronous multi-byte register read.
- * reg: The hardware register to start reading from.
- * count: The number of bytes to read.
- * Returns a pointer to the receive buffer on success,
- * or NULL on error.
+/* Start an EEPROM state machine register read.
+ * The value is read into aux_buffer[0].
+ * reg: The hardware register to read.
  */
-static const uint8_t * rv3029_read(uint8_t reg, uint8_t count)
+static void rv3029_ee_read(uint8_t reg)
 {
 	struct rv3029_device *dev = &rv3029_dev;
-	enum twi_status stat;
 
-	/* Schedule an asynchronous read and wait afterwards. */
-	rv3029_read_async(reg, count, NULL);
-	stat = twi_transfer_wait(&dev->xfer, RV3029_I2C_TIMEOUT);
-	if (stat != TWI_STAT_FINISHED)
-		return NULL;
+	dev->aux_buffer[0] = reg;
+	dev->aux_xfer.write_size = 1;
+	dev->aux_xfer.read_size = 1;
+	dev->aux_xfer.callback = NULL;
 
-	return dev->xfer_buffer;
+	twi_transfer(&dev->aux_xfer);
 }
 
-/* Synchronously read a byte-wide register.
- * reg: The hardware register to read. */
-static uint8_t rv3029_read_byte(uint8_t reg)
+/* Start an EEPROM state machine register write.
+ * reg: The hardware register to write.
+ * value: The value to write.
+ */
+static void rv3029_ee_write(uint8_t reg, uint8_t value)
 {
-	const uint8_t *buffer;
-	uint8_t retval = 0;
-
-	buffer = rv3029_read(reg, sizeof(retval));
-	if (buffer)
-		retval = buffer[0];
+	struct rv3029_device *dev = &rv3029_dev;
 
-	return retval;
-}
+	dev->aux_buffer[0] = reg;
+	dev->aux_buffer[1] = value;
+	dev->aux_xfer.write_size = 2;
+	dev->aux_xfer.read_size = 0;
+	dev->aux_xfer.callback = NULL;
 
-/* Check whether the RV-3029 EEPROM is busy. */
-static bool rv3029_eeprom_busy(void)
-{
-	return !!(rv3029_read_byte(RV3029_REG_STATUS) &
-		  (1 << RV3029_STATUS_EEBUSY));
+	twi_transfer(&dev->aux_xfer);
 }
 
-/* Write to RV-3029 EEPROM.
+/* Schedule an asynchronous write to RV-3029 EEPROM.
+ * The write is done by rv3029_eeprom_work().
  * reg: The EEPROM register.
  * value: The value to write.
+ * Returns 1, if the write was scheduled,
+ * or 0, if another EEPROM write or a temperature read is still running.
  */
-static void rv3029_eeprom_write(uint8_t reg, uint8_t value)
+static bool rv3029_eeprom_write(uint8_t reg, uint8_t value)
 {
-	uint8_t old_onoffctrl, old_value, status;
+	struct rv3029_device *dev = &rv3029_dev;
+
+	if (dev->ee_state != RV3029_EE_IDLE)
+		return 0;
+	if (twi_transfer_get_status(&dev->aux_xfer) == TWI_STAT_INPROGRESS)
+		return 0;
+
+	dev->ee_reg = reg;
+	dev->ee_value = value;
+	dev->ee_timeout = jiffies_get() + msec_to_jiffies(RV3029_EE_TIMEOUT_MS);
 
 	/* Wait for voltage level Vcc > Vprog */
-	status = rv3029_read_byte(RV3029_REG_STATUS);
-	if (status & ((1 << RV3029_STATUS_VLOW1) |
-		      (1 << RV3029_STATUS_VLOW2))) {
-		while (1) {
-			status = rv3029_read_byte(RV3029_REG_STATUS);
-			if (!(status & ((1 << RV3029_STATUS_VLOW1) |
-				        (1 << RV3029_STATUS_VLOW2)))) {
-				_delay_ms(50);
-				break;
-			}
-			status &= ~(1 << RV3029_STATUS_VLOW1);
-			status &= ~(1 << RV3029_STATUS_VLOW2);
-			rv3029_write_byte(RV3029_REG_STATUS, status);
-		}
-	}
+	dev->ee_state = RV3029_EE_VLOW;
+	rv3029_ee_read(RV3029_REG_STATUS);
+
+	return 1;
+}
 
-	/* Clear EERefOn bit before accessing EEPROM */
-	old_onoffctrl = rv3029_read_byte(RV3029_REG_ONOFFCTRL);
-	rv3029_write_byte(RV3029_REG_ONOFFCTRL,
-			  old_onoffctrl & ~(1 << RV3029_ONOFFCTRL_EEREFON));
+/* Abort the running EEPROM write after an error or timeout. */
+static void rv3029_eeprom_abort(void)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+	enum rv3029_ee_state state = dev->ee_state;
+
+	notify_led_raise(NOTIFY_LED_RTC);
+	log_error(LOG_ERR_RTC, state);
+
+	if (state >= RV3029_EE_REFOFF && state < RV3029_EE_RESTORE) {
+		/* EERefOn might be cleared. Try to restore it. */
+		dev->ee_timeout = jiffies_get() + msec_to_jiffies(RV3029_I2C_TIMEOUT);
+		dev->ee_state = RV3029_EE_RESTORE;
+		rv3029_ee_write(RV3029_REG_ONOFFCTRL, dev->ee_onoffctrl);
+		return;
+	}
+	dev->ee_state = RV3029_EE_IDLE;
+}
 
-	while (rv3029_eeprom_busy())
-		; /* Busy-wait */
+/* Run the EEPROM write state machine.
+ * Each call advances the state machine by at most one I2C transfer.
+ */
+static void rv3029_eeprom_work(void)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+	enum twi_status status;
+	jiffies_t now;
+	uint8_t value;
 
-	/* Write the new value, if it changed. */
-	old_value = rv3029_read_byte(reg);
-	if (value != old_value)
-		rv3029_write_byte(reg, value);
+	if (dev->ee_state == RV3029_EE_IDLE)
+		return;
 
-	while (rv3029_eeprom_busy())
-		; /* Busy-wait */
+	now = jiffies_get();
+	status = twi_transfer_get_status(&dev->aux_xfer);
+	if (status == TWI_STAT_INPROGRESS) {
+		if (time_before(now, dev->ee_timeout))
+			return;
+		twi_transfer_cancel(&dev->aux_xfer);
+		status = TWI_STAT_TIMEOUT;
+	}
+	if (status != TWI_STAT_FINISHED ||
+	    !time_before(now, dev->ee_timeout)) {
+		rv3029_eeprom_abort();
+		return;
+	}
 
-	/* Restore EERefOn bit */
-	rv3029_write_byte(RV3029_REG_ONOFFCTRL, old_onoffctrl);
+	value = dev->aux_buffer[0];
+	switch (dev->ee_state) {
+	case RV3029_EE_IDLE:
+		break;
+	case RV3029_EE_VLOW:
+		if (value & ((1 << RV3029_STATUS_VLOW1) |
+			     (1 << RV3029_STATUS_VLOW2))) {
+			/* Clear the voltage low flags and check again. */
+			value &= ~(1 << RV3029_STATUS_VLOW1);
+			value &= ~(1 << RV3029_STATUS_VLOW2);
+			dev->ee_state = RV3029_EE_CLRVLOW;
+			rv3029_ee_write(RV3029_REG_STATUS, value);
+			break;
+		}
+		/* Clear EERefOn bit before accessing EEPROM */
+		dev->ee_state = RV3029_EE_ONOFF;
+		rv3029_ee_read(RV3029_REG_ONOFFCTRL);
+		break;
+	case RV3029_EE_CLRVLOW:
+		dev->ee_settle = now + msec_to_jiffies(50);
+		dev->ee_state = RV3029_EE_SETTLE;
+		break;
+	case RV3029_EE_SETTLE:
+		if (time_before(now, dev->ee_settle))
+			break;
+		dev->ee_state = RV3029_EE_VLOW;
+		rv3029_ee_read(RV3029_REG_STATUS);
+		break;
+	case RV3029_EE_ONOFF:
+		dev->ee_onoffctrl = value;
+		dev->ee_state = RV3029_EE_REFOFF;
+		rv3029_ee_write(RV3029_REG_ONOFFCTRL,
+				value & ~(1 << RV3029_ONOFFCTRL_EEREFON));
+		break;
+	case RV3029_EE_REFOFF:
+		dev->ee_state = RV3029_EE_BUSY1;
+		rv3029_ee_read(RV3029_REG_STATUS);
+		break;
+	case RV3029_EE_BUSY1:
+		if (value & (1 << RV3029_STATUS_EEBUSY)) {
+			rv3029_ee_read(RV3029_REG_STATUS);
+			break;
+		}
+		dev->ee_state = RV3029_EE_READ;
+		rv3029_ee_read(dev->ee_reg);
+		break;
+	case RV3029_EE_READ:
+		if (value == dev->ee_value) {
+			/* The value did not change. Skip the write. */
+			dev->ee_state = RV3029_EE_RESTORE;
+			rv3029_ee_write(RV3029_REG_ONOFFCTRL, dev->ee_onoffctrl);
+			break;
+		}
+		dev->ee_state = RV3029_EE_WRITE;
+		rv3029_ee_write(dev->ee_reg, dev->ee_value);
+		break;
+	case RV3029_EE_WRITE:
+		dev->ee_state = RV3029_EE_BUSY2;
+		rv3029_ee_read(RV3029_REG_STATUS);
+		break;
+	case RV3029_EE_BUSY2:
+		if (value & (1 << RV3029_STATUS_EEBUSY)) {
+			rv3029_ee_read(RV3029_REG_STATUS);
+			break;
+		}
+		/* Restore EERefOn bit */
+		dev->ee_state = RV3029_EE_RESTORE;
+		rv3029_ee_write(RV3029_REG_ONOFFCTRL, dev->ee_onoffctrl);
+		break;
+	case RV3029_EE_RESTORE:
+		dev->ee_state = RV3029_EE_IDLE;
+		break;
+	}
 }
 
 /* Convert a given time from hardware-BCD-format to binary format. */
@@ -436,15 +648,41 @@ void rv3029_write_time(const struct rtc_time *time)
 	/* Update the cached time. */
 	sreg = irq_disable_save();
 	dev->now = *time;
+	dev->now_jiffies = jiffies_get();
+	dev->slew = 0;
 	irq_restore(sreg);
 }
 
+/* Advance the software clock by the number of full seconds
+ * that passed since the start of the cached second.
+ * Must be called with interrupts disabled.
+ */
+static void rv3029_advance_time(struct rv3029_device *dev)
+{
+	jiffies_t now = jiffies_get();
+
+	while (now - dev->now_jiffies >= JPS + dev->slew) {
+		rtc_time_inc_second(&dev->now);
+		dev->now_jiffies += JPS + dev->slew;
+		dev->slew = 0;
+	}
+}
+
 /* Async-read callback */
 static void read_time_callback(struct twi_transfer *xfer, enum twi_status status)
 {
 	struct rv3029_device *dev = &rv3029_dev;
-	struct rtc_time bcd_time;
+	struct rtc_time bcd_time, time;
 	uint8_t sreg;
+#if RV3029_IRQ
+	bool irq_sync;
+
+	/* This read completes the interrupt triggered resync. */
+	sreg = irq_disable_save();
+	irq_sync = dev->irq_sync;
+	dev->irq_sync = 0;
+	irq_restore(sreg);
+#endif
 
 	if (status != TWI_STAT_FINISHED) {
 		/* I2C finished with an error. */
@@ -462,20 +700,64 @@ static void read_time_callback(struct twi_transfer *xfer, enum twi_status status
 	bcd_time.year = dev->xfer_buffer[6];
 	irq_restore(sreg);
 
-	/* Convert from BCD hardware format to binary and store in cache. */
-	rv3029_time_bcd_to_bin(&dev->now, &bcd_time);
+	/* Convert from BCD hardware format to binary. */
+	rv3029_time_bcd_to_bin(&time, &bcd_time);
+
+	sreg = irq_disable_save();
+#if RV3029_IRQ
+	if (irq_sync) {
+		/* The interrupt marks the exact start of the second. */
+		dev->now = time;
+		dev->now_jiffies = dev->irq_jiffies;
+		dev->slew = 0;
+		dev->aligned = 1;
+		irq_restore(sreg);
+		return;
+	}
+#endif
+	rv3029_advance_time(dev);
+	if (!dev->aligned) {
+		if (dev->align_second != RV3029_NO_SECOND &&
+		    dev->align_second != time.second) {
+			/* The seconds changed since the previous poll.
+			 * This is the start of the RTC second. */
+			dev->now_jiffies = jiffies_get();
+			dev->slew = 0;
+			dev->aligned = 1;
+		}
+		dev->align_second = time.second;
+		dev->now = time;
+		irq_restore(sreg);
+		return;
+	}
+	/* Without the interrupt the start of the second is only known
+	 * to be somewhere in the last second. Taking the time of this
+	 * callback as the start would add a random phase error.
+	 * Keep the sub-second phase of the software clock and only
+	 * correct the whole seconds.
+	 */
+	if (rtc_get_timestamp(&time) >= rtc_get_timestamp(&dev->now)) {
+		dev->now = time;
+	} else {
+		/* The software clock runs ahead of the RTC.
+		 * Never step it backwards. Stretch the current second
+		 * instead. It ends one second from now, which is not
+		 * before the RTC second ends.
+		 */
+		dev->slew = jiffies_get() - dev->now_jiffies;
+	}
+	irq_restore(sreg);
 }
 
-/* Update the cached time. */
-void rv3029_read_time(void)
+/* Schedule a read of the watch registers.
+ * read_time_callback() will be called after I2C read finished.
+ */
+static void rv3029_read_time(void)
 {
-	/* Poke an asynchronous read of the watch registers.
-	 * read_time_callback() will be called after I2C read finished.
-	 */
 	rv3029_read_async(RV3029_REG_WSECONDS, 7, read_time_callback);
 }
 
-/* Returns the currently cached time.
+/* Returns the current time of the software clock.
  * time: Pointer to the destination buffer.
  */
 void rv3029_get_time(struct rtc_time *time)
@@ -484,23 +766,217 @@ void rv3029_get_time(struct rtc_time *time)
 	uint8_t sreg;
 
 	sreg = irq_disable_save();
+	rv3029_advance_time(dev);
+	*time = dev->now;
+	irq_restore(sreg);
+}
+
+/* Get the current time of the software clock and the sub-second part.
+ * The sub-second part is the number of jiffies since the start
+ * of the current second.
+ * Returns the sub-second part.
+ */
+uint8_t rv3029_get_time_subsec(struct rtc_time *time)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+	jiffies_t elapsed;
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	rv3029_advance_time(dev);
 	*time = dev->now;
+	elapsed = jiffies_get() - dev->now_jiffies;
+	irq_restore(sreg);
+
+	return (uint8_t)min(elapsed, JPS - 1);
+}
+
+/* Async temperature read callback */
+static void read_temperature_callback(struct twi_transfer *xfer,
+				      enum twi_status status)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+	uint8_t sreg;
+
+	if (status != TWI_STAT_FINISHED) {
+		/* I2C finished with an error. */
+		return;
+	}
+
+	/* The register holds the temperature plus 60 degree Celsius. */
+	sreg = irq_disable_save();
+	dev->temp = (int8_t)(min(dev->aux_buffer[0], INT8_MAX + RV3029_TEMP_OFFSET)
+			     - RV3029_TEMP_OFFSET);
+	irq_restore(sreg);
+}
+
+/* Update the cached temperature.
+ * This does not wait for the previous time read to finish.
+ * The temperature read uses its own transfer context
+ * and is queued behind it.
+ * A running EEPROM write owns that context. The read is skipped then.
+ */
+static void rv3029_read_temperature(void)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+
+	if (dev->ee_state != RV3029_EE_IDLE)
+		return;
+	if (twi_transfer_get_status(&dev->aux_xfer) == TWI_STAT_INPROGRESS) {
+		/* The previous read did not finish, yet. */
+		return;
+	}
+
+	dev->aux_buffer[0] = RV3029_REG_TEMP;
+	dev->aux_xfer.write_size = 1;
+	dev->aux_xfer.read_size = 1;
+	dev->aux_xfer.callback = read_temperature_callback;
+
+	twi_transfer(&dev->aux_xfer);
+}
+
+/* Returns the currently cached temperature, in degree Celsius.
+ * Returns RV3029_TEMP_UNKNOWN, if the temperature was not read, yet.
+ */
+int8_t rv3029_get_temperature(void)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+	uint8_t sreg;
+	int8_t temp;
+
+	sreg = irq_disable_save();
+	temp = dev->temp;
+	irq_restore(sreg);
+
+	return temp;
+}
+
+#if RV3029_IRQ
+/* Schedule clearing of the interrupt flags.
+ * This releases the /INT line, so that the next alarm
+ * generates a new falling edge.
+ */
+static void rv3029_clear_irqflags(void)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+
+	if (twi_transfer_get_status(&dev->irq_xfer) == TWI_STAT_INPROGRESS) {
+		/* The previous write did not finish, yet. */
+		return;
+	}
+
+	dev->irq_buffer[0] = RV3029_REG_IRQFLAGS;
+	dev->irq_buffer[1] = 0;
+	dev->irq_xfer.write_size = 2;
+	dev->irq_xfer.read_size = 0;
+
+	twi_transfer(&dev->irq_xfer);
+}
+
+/* RV-3029 /INT interrupt: The full minute alarm. */
+ISR(INT0_vect)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+
+	dev->irq_jiffies = jiffies_get();
+	dev->irq_pending = 1;
+}
+#endif /* RV3029_IRQ */
+
+/* Periodic work.
+ * Runs the EEPROM write state machine.
+ * Resynchronises the software clock and the temperature
+ * from the hardware, if the interrupt fired or if the
+ * resynchronisation interval expired.
+ */
+void rv3029_work(void)
+{
+	struct rv3029_device *dev = &rv3029_dev;
+	jiffies_t now = jiffies_get();
+	bool resync = 0;
+#if RV3029_IRQ
+	uint8_t sreg;
+#endif
+
+	/* Advance a running EEPROM write. */
+	rv3029_eeprom_work();
+
+#if RV3029_IRQ
+
+	sreg = irq_disable_save();
+	if (dev->irq_pending) {
+		dev->irq_pending = 0;
+		resync = 1;
+	}
 	irq_restore(sreg);
+
+	/* Wait for the previous read to finish before switching
+	 * the time base of read_time_callback(). The callback of
+	 * the read scheduled below clears the flag again.
+	 */
+	if (resync) {
+		twi_transfer_wait(&dev->xfer, RV3029_I2C_TIMEOUT);
+		dev->irq_sync = 1;
+	}
+#endif
+
+	if (!resync && !dev->aligned) {
+		if (time_before(now, dev->next_resync)) {
+			/* Poll the seconds register once per jiffy,
+			 * until it changes. */
+			if (now != dev->align_jiffies &&
+			    twi_transfer_get_status(&dev->xfer) != TWI_STAT_INPROGRESS) {
+				dev->align_jiffies = now;
+				rv3029_read_time();
+			}
+			return;
+		}
+		/* The RTC did not answer. Keep the current phase. */
+		dev->aligned = 1;
+	}
+
+	if (!time_before(now, dev->next_resync))
+		resync = 1;
+	if (!resync)
+		return;
+	dev->next_resync = now + sec_to_jiffies(RV3029_RESYNC_SEC);
+
+	/* Read the current time and temperature from RTC. */
+	rv3029_read_time();
+	rv3029_read_temperature();
+#if RV3029_IRQ
+	rv3029_clear_irqflags();
+#endif
 }
 
 /* Initialize the RTC */
 void rv3029_init(void)
 {
 	struct rv3029_device *dev = &rv3029_dev;
+#if RV3029_IRQ
+	uint8_t alarm[7];
+#endif
 	uint8_t tmp;
 
 	/* Reset the device data structure. */
 	memset(dev, 0, sizeof(*dev));
 
-	/* Initialize I2C transfer data structure. */
+	/* Initialize I2C transfer data structures. */
 	twi_transfer_init(&dev->xfer);
 	dev->xfer.address = RV3029_I2C_ADDRESS;
+	dev->xfer.speed = RV3029_TWI_SPEED;
 	dev->xfer.buffer = dev->xfer_buffer;
+	twi_transfer_init(&dev->aux_xfer);
+	dev->aux_xfer.address = RV3029_I2C_ADDRESS;
+	dev->aux_xfer.speed = RV3029_TWI_SPEED;
+	dev->aux_xfer.buffer = dev->aux_buffer;
+	dev->temp = RV3029_TEMP_UNKNOWN;
+#if RV3029_IRQ
+	twi_transfer_init(&dev->irq_xfer);
+	dev->irq_xfer.address = RV3029_I2C_ADDRESS;
+	dev->irq_xfer.speed = RV3029_TWI_SPEED;
+	dev->irq_xfer.buffer = dev->irq_buffer;
+#endif
 
 	/* Reset the device */
 	rv3029_write_byte(RV3029_REG_RSTCTRL, (1 << RV3029_RSTCTRL_SYSRES));
@@ -514,14 +990,6 @@ void rv3029_init(void)
 	/* Clear interrupt flags */
 	rv3029_write_byte(RV3029_REG_IRQFLAGS, 0);
 
-	/* Enable thermometer, scan period 1 second,
-	 * Timer 32786 Hz,
-	 * 1k trickle charge resistor.
-	 */
-	tmp = (1 << RV3029_EECTRL_THEN) |
-	      (1 << RV3029_EECTRL_R1K);
-	rv3029_eeprom_write(RV3029_REG_EECTRL, tmp);
-
 	/* Enable IRQ pin,
 	 * Timer frequency 32 Hz,
 	 * Enable self recovery.
@@ -535,4 +1003,43 @@ void rv3029_init(void)
 	      (1 << RV3029_ONOFFCTRL_TRON) |
 	      (1 << RV3029_ONOFFCTRL_WAON);
 	rv3029_write_byte(RV3029_REG_ONOFFCTRL, tmp);
+
+	/* Enable thermometer, scan period 1 second,
+	 * Timer 32786 Hz,
+	 * 1k trickle charge resistor.
+	 * The EEPROM write is done from rv3029_work().
+	 */
+	tmp = (1 << RV3029_EECTRL_THEN) |
+	      (1 << RV3029_EECTRL_R1K);
+	rv3029_eeprom_write(RV3029_REG_EECTRL, tmp);
+
+#if RV3029_IRQ
+	/* Alarm on every full minute:
+	 * Only compare the seconds against 00.
+	 */
+	memset(alarm, 0, sizeof(alarm));
+	alarm[0] = (1 << RV3029_ASECONDS_SECEQ);
+	rv3029_write(RV3029_REG_ASECONDS, alarm, sizeof(alarm));
+	/* Enable the alarm interrupt. */
+	rv3029_write_byte(RV3029_REG_IRQCTRL, (1 << RV3029_IRQCTRL_AINTE));
+
+	/* The /INT output is open-drain. Enable the pull-up. */
+	RV3029_IRQ_DDR &= ~(1 << RV3029_IRQ_BIT);
+	RV3029_IRQ_PORT |= (1 << RV3029_IRQ_BIT);
+	/* INT0 on the falling edge. */
+	MCUCR = (uint8_t)((MCUCR & ~((1 << ISC01) | (1 << ISC00))) |
+			  (1 << ISC01));
+	GIFR = (1 << INTF0);
+	GICR |= (1 << INT0);
+#endif
+
+	/* Fetch the initial time.
+	 * The system timer does not run, yet. rv3029_work() aligns the
+	 * start of the second to the RTC, once the mainloop runs.
+	 * Do not use this read as the first alignment poll. */
+	dev->align_second = RV3029_NO_SECOND;
+	rv3029_read_time();
+	twi_transfer_wait(&dev->xfer, RV3029_I2C_TIMEOUT);
+	dev->align_second = RV3029_NO_SECOND;
+	dev->next_resync = jiffies_get() + sec_to_jiffies(RV3029_RESYNC_SEC);
 }
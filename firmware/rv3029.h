@@ -7,10 +7,35 @@
 #include <stdint.h>
 
 
+/* Use the RV-3029 /INT output connected to INT0 (PD2).
+ * The RTC raises an alarm interrupt on every full minute and the
+ * cached time is resynchronised on that interrupt.
+ * Only enable this, if /INT is wired to PD2 on the board.
+ */
+#ifndef RV3029_IRQ
+# define RV3029_IRQ	0
+#endif
+
+/* Talk to the RV-3029 in 400 kHz fast mode.
+ * The RTC shares the bus with the valve I/O expander. The PCF8574 is
+ * specified for 100 kHz only, so this requires a 400 kHz capable
+ * expander, e.g. the PCA8574.
+ */
+#ifndef RV3029_TWI_FAST
+# define RV3029_TWI_FAST	0
+#endif
+
+
 void rv3029_write_time(const struct rtc_time *time);
-void rv3029_read_time(void);
 void rv3029_get_time(struct rtc_time *time);
+uint8_t rv3029_get_time_subsec(struct rtc_time *time);
+
+/* Temperature value for "temperature not known, yet". */
+#define RV3029_TEMP_UNKNOWN	INT8_MIN
+
+int8_t rv3029_get_temperature(void);
 
+void rv3029_work(void);
 void rv3029_init(void);
 
 #endif /* RV3029_H_ */
@@ -24,23 +24,100 @@
 
 #include <string.h>
 
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr/eeprom.h>
+
 
 /* Warmup time:	The time to wait with sensor _enabled_
- *		before performing one measurement. */
-#define WARMUP_TIME		msec_to_jiffies(50)
+ *		before performing one measurement.
+ *		This is configured per sensor.
+ * Wait time:	The time to wait with sensor _disabled_
+ *		between measurements.
+ *		This is configured per sensor.
+ */
 
-/* Wait time:	The time to wait with sensor _disabled_
- *		between measurements. */
-#define WAIT_TIME		msec_to_jiffies(500)
+/* Warmup auto-tuning:
+ *		The warmup time is shortened by one jiffy after each
+ *		measurement, as long as the spread of the measured
+ *		values does not grow by more than
+ *		SENSOR_AUTOTUNE_TOLERANCE ADC steps compared to the
+ *		spread at the configured warmup time.
+ *		If it grows more, the warmup time is increased again
+ *		by SENSOR_AUTOTUNE_STEPUP jiffies.
+ *		Auto-tuning requires at least two measurement cycles.
+ */
+#ifndef SENSOR_AUTOTUNE_TOLERANCE
+# define SENSOR_AUTOTUNE_TOLERANCE	2
+#endif
+#ifndef SENSOR_AUTOTUNE_STEPUP
+# define SENSOR_AUTOTUNE_STEPUP		2
+#endif
+
+/* ADC noise reduction sleep:
+ *		If enabled, the CPU enters the ADC noise reduction sleep
+ *		mode for the duration of each sensor conversion.
+ *		Note that this also halts the I/O clock. So the UART and
+ *		the system timer are stopped while converting.
+ */
+#ifndef SENSOR_ADC_SLEEP
+# define SENSOR_ADC_SLEEP	0
+#endif
+
+/* Supply voltage compensation:
+ *		The supply voltage is measured against the internal
+ *		bandgap reference at the start of each measurement.
+ *		If SENSOR_VCC_COMP is enabled, the measurement results
+ *		are scaled from the actual supply voltage to
+ *		SENSOR_VCC_NOMINAL_MV.
+ *		Only enable this, if the ADC reference is not derived
+ *		from Vcc. On the stock board the sensor dividers are fed
+ *		from the Vcc rail and the ADC uses the AVcc reference.
+ *		So the measurement is ratiometric already and the
+ *		compensation would add an error proportional to the
+ *		Vcc deviation. The measured Vcc is reported in any case.
+ *		SENSOR_BANDGAP_MV is the bandgap voltage. The typical
+ *		value is 1.30 V, but it varies from chip to chip.
+ *		It can be calibrated here.
+ */
+#ifndef SENSOR_VCC_COMP
+# define SENSOR_VCC_COMP	0
+#endif
+#ifndef SENSOR_VCC_NOMINAL_MV
+# define SENSOR_VCC_NOMINAL_MV	5000
+#endif
+#ifndef SENSOR_BANDGAP_MV
+# define SENSOR_BANDGAP_MV	1300
+#endif
+/* The number of bandgap conversions per supply voltage measurement. */
+#define SENSOR_VCC_SAMPLES	4
+
+/* ADC multiplexer settings. */
+#define SENSOR_ADMUX		((1 << REFS0))
+#define SENSOR_ADMUX_BANDGAP	((1 << REFS0) | (1 << MUX3) | (1 << MUX2) | (1 << MUX1))
+
+/* Raw ADC stream FIFO size:
+ *		The number of raw conversions buffered for transmission
+ *		to the host. Must be a power of two.
+ */
+#ifndef SENSOR_STREAM_FIFO_SIZE
+# define SENSOR_STREAM_FIFO_SIZE	8
+#endif
+#define SENSOR_STREAM_FIFO_MASK	(SENSOR_STREAM_FIFO_SIZE - 1)
 
 
 /* Sensor state-machine values. */
 enum sensor_status {
 	STAT_IDLE,	/* Idle: No measurement requested. */
+	STAT_VCC_CONV,	/* Vcc-conv: Supply voltage measurement in progress. */
+	STAT_VCC_DONE,	/* Vcc-done: Supply voltage measurement finished. */
 	STAT_WAIT,	/* Wait: Wait time between measurements. */
 	STAT_WARMUP_P0,	/* Warmup: First warmup time before measurement. */
+	STAT_ADC_CONV_P0, /* ADC-conv: Polarity 0 conversion in progress. */
+	STAT_ADC_DONE_P0, /* ADC-done: Polarity 0 conversion finished. */
 	STAT_WARMUP_P1,	/* Warmup: Second warmup time before measurement. */
-	STAT_ADC_CONV,	/* ADC-conv: ADC-conversion is in progress. */
+	STAT_ADC_CONV_P1, /* ADC-conv: Polarity 1 conversion in progress. */
+	STAT_ADC_DONE_P1, /* ADC-done: Polarity 1 conversion finished. */
 };
 
 /* Context of a measurement. */
@@ -53,14 +130,89 @@ struct sensor_context {
 	 * measurement, if any. */
 	uint8_t nr;
 
-	/* Temporary buffer for the measured values. */
-	uint16_t values[3];
+	/* The configuration of the current measurement. */
+	struct sensor_config conf;
+	/* The warmup time of the current measurement, in jiffies. */
+	uint8_t warmup;
+	/* The wait time of the current measurement, in jiffies. */
+	uint16_t wait;
+
+	/* The sum of the ADC conversions of the current cycle.
+	 * Written by the ADC interrupt handler. */
+	uint16_t adc_sum;
+	/* The number of ADC conversions left in the current cycle. */
+	uint8_t adc_count;
+	/* The ADC conversion sum of the polarity 0 phase. */
+	uint16_t adc_sum_p0;
+	/* The sum of the polarity asymmetries of all cycles. */
+	int16_t asym_sum;
+
+	/* Temporary buffer for the measured values.
+	 * These are fixed point values with
+	 * SENSOR_FILTER_FRACT_BITS fractional bits. */
+	uint16_t values[SENSOR_MAX_CYCLES];
 	uint8_t value_count;
 };
 
 /* Instance of the measurement context. */
 static struct sensor_context sensor;
 
+/* The last measured supply voltage, in millivolts.
+ * Zero, if not measured, yet. */
+static uint16_t sensor_vcc_mv;
+
+/* The IIR filter states of the sensors. */
+static struct sensor_filter_iir sensor_iir[SENSOR_COUNT];
+
+/* Warmup auto-tuning state of a sensor. */
+struct sensor_tuning {
+	/* The tuned warmup time, in jiffies.
+	 * Zero, if tuning did not start, yet. */
+	uint8_t warmup;
+	/* The value spread at the configured warmup time.
+	 * Fixed point value with SENSOR_FILTER_FRACT_BITS. */
+	uint16_t spread_ref;
+};
+
+/* The warmup auto-tuning states of the sensors. */
+static struct sensor_tuning sensor_tuning[SENSOR_COUNT];
+
+#if SENSOR_STREAM
+/* Raw ADC stream context. */
+struct sensor_stream_context {
+	/* Streaming is enabled. */
+	bool enabled;
+	/* The FIFO overflowed. Samples were lost. */
+	bool overflow;
+	/* Bitmask of the streamed sensors. */
+	uint8_t sensor_mask;
+	/* Only every n-th conversion is streamed. */
+	uint8_t decimation;
+	/* The number of conversions to skip until the next sample. */
+	uint8_t skip;
+	/* The sample FIFO. */
+	struct sensor_stream_sample fifo[SENSOR_STREAM_FIFO_SIZE];
+	uint8_t in_ptr;
+	uint8_t out_ptr;
+	uint8_t count;
+};
+
+/* Instance of the raw ADC stream context. */
+static struct sensor_stream_context stream;
+#endif
+
+/* The EEPROM memory for storage of the sensor configurations. */
+static struct sensor_config EEMEM eeprom_sensor_configs[SENSOR_COUNT] = {
+	[0 ... (SENSOR_COUNT - 1)] = {
+		.filter		= SENSOR_FILTER_MEDIAN,
+		.nr_cycles	= 3,
+		.oversample	= 2,
+		.warmup_ms	= 50,
+		.wait_ms	= 500,
+		.flags		= 0,
+	},
+};
+
 /* Port mappings for the supply-A lines of the sensors.
  * The array indices are the sensor number.
  * The array values are the port/ddr bit number, DDR register
@@ -97,37 +249,6 @@ static volatile uint8_t * const PROGMEM sensor_a_port[] = {
 #define SENSOR_SUPPLY_B_BIT		3
 
 
-/* The number of available sensors. */
-#define SENSOR_COUNT	ARRAY_SIZE(sensor_a_bit)
-
-
-/* Read the current ADC value. */
-static uint16_t sensor_adc_read_value(void)
-{
-	return ADCW;
-}
-
-/* Start an ADC conversion. */
-static void sensor_adc_start(void)
-{
-	/* Initialize ADC to 125 kHz (on 16 MHz CPU).
-	 * Select AVcc reference.
-	 * Set multiplexer to ADC0.
-	 */
-	build_assert(F_CPU == 16000000ul);
-	ADMUX = (1 << REFS0);
-	ADCSRA = (1 << ADEN) | (1 << ADPS0) | (1 << ADPS1) | (1 << ADPS2);
-	ADCSRA |= (1 << ADSC);
-}
-
-/* Returns the boolean state of the ADC unit.
- * 0: conversion active.  1: conversion done.
- */
-static bool sensor_adc_done(void)
-{
-	return !(ADCSRA & (1 << ADSC));
-}
-
 /* Get the port access values for a sensor "A" supply.
  * sensor_nr: The sensor number to get the values for.
  * bitmask: Pointer to the returned bitmask.
@@ -202,17 +323,256 @@ static void sensor_disable(uint8_t nr)
 	irq_restore(sreg);
 }
 
+/* Start an ADC conversion.
+ * The result is delivered by the ADC interrupt.
+ */
+static void sensor_adc_start(void)
+{
+#if SENSOR_ADC_SLEEP
+	if (irqs_enabled()) {
+		/* Entering the ADC noise reduction sleep mode
+		 * automatically starts the conversion.
+		 * The ADC interrupt wakes us up again.
+		 */
+		set_sleep_mode(SLEEP_MODE_ADC);
+		sleep_enable();
+		sleep_cpu();
+		sleep_disable();
+		return;
+	}
+#endif
+	ADCSRA |= (1 << ADSC);
+}
+
+#if SENSOR_STREAM
+/* Record a raw ADC conversion into the stream FIFO.
+ * Called from the ADC interrupt handler.
+ * adc: The raw ADC value.
+ */
+static void sensor_stream_push(uint16_t adc)
+{
+	struct sensor_stream_sample *sample;
+
+	if (!stream.enabled)
+		return;
+	if (!(stream.sensor_mask & BITMASK8(sensor.nr)))
+		return;
+	if (stream.skip) {
+		/* Decimation. */
+		stream.skip--;
+		return;
+	}
+	stream.skip = stream.decimation - 1;
+	if (stream.count >= SENSOR_STREAM_FIFO_SIZE) {
+		/* FIFO overflow. Drop the sample. */
+		stream.overflow = 1;
+		return;
+	}
+
+	sample = &stream.fifo[stream.in_ptr];
+	sample->jiffies = (uint16_t)jiffies_get();
+	sample->data = SENSOR_STREAM_DATA(sensor.nr,
+					  sensor.stat == STAT_ADC_CONV_P1,
+					  adc);
+	if (stream.overflow) {
+		sample->data |= SENSOR_STREAM_LOST;
+		stream.overflow = 0;
+	}
+	stream.in_ptr = (stream.in_ptr + 1) & SENSOR_STREAM_FIFO_MASK;
+	stream.count++;
+}
+
+/* Enable or disable raw ADC streaming.
+ * enable: True, if streaming shall be enabled.
+ * sensor_mask: Bitmask of the streamed sensors. 0 selects all sensors.
+ * decimation: Only stream every n-th conversion. 0 is the same as 1.
+ */
+void sensor_stream_enable(bool enable, uint8_t sensor_mask,
+			  uint8_t decimation)
+{
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	memset(&stream, 0, sizeof(stream));
+	stream.enabled = enable;
+	stream.sensor_mask = sensor_mask ? sensor_mask : 0xFF;
+	stream.decimation = decimation ? decimation : 1;
+	irq_restore(sreg);
+}
+
+/* Check whether raw ADC streaming is enabled. */
+bool sensor_stream_enabled(void)
+{
+	mb();
+	return stream.enabled;
+}
+
+/* Fetch raw ADC samples from the stream FIFO.
+ * samples: Pointer to the destination array.
+ * max_count: The size of the destination array.
+ * Returns the number of fetched samples.
+ */
+uint8_t sensor_stream_pop(struct sensor_stream_sample *samples,
+			  uint8_t max_count)
+{
+	uint8_t sreg, count = 0;
+
+	sreg = irq_disable_save();
+	while (stream.count && count < max_count) {
+		samples[count++] = stream.fifo[stream.out_ptr];
+		stream.out_ptr = (stream.out_ptr + 1) & SENSOR_STREAM_FIFO_MASK;
+		stream.count--;
+	}
+	irq_restore(sreg);
+
+	return count;
+}
+#else
+static inline void sensor_stream_push(uint16_t adc) { }
+#endif
+
+/* ADC conversion-complete interrupt. */
+ISR(ADC_vect)
+{
+	uint16_t adc;
+
+	mb();
+	if (sensor.stat == STAT_VCC_CONV) {
+		/* Bandgap conversion.
+		 * The first conversion is discarded,
+		 * because the bandgap needs time to settle. */
+		if (sensor.adc_count <= SENSOR_VCC_SAMPLES)
+			sensor.adc_sum += ADCW;
+		if (--sensor.adc_count)
+			ADCSRA |= (1 << ADSC);
+		else
+			sensor.stat = STAT_VCC_DONE;
+	} else if (sensor.stat == STAT_ADC_CONV_P0 ||
+	    sensor.stat == STAT_ADC_CONV_P1) {
+		/* Accumulate the result. */
+		adc = ADCW;
+		sensor.adc_sum += adc;
+		sensor_stream_push(adc);
+		if (--sensor.adc_count) {
+			/* Oversampling: Start the next conversion
+			 * right away. */
+			ADCSRA |= (1 << ADSC);
+		} else if (sensor.stat == STAT_ADC_CONV_P0) {
+			/* All conversions of the polarity 0 phase done.
+			 * Switch to polarity 1 immediately. */
+			sensor_enable(sensor.nr, 1);
+			sensor.stat = STAT_ADC_DONE_P0;
+		} else {
+			/* All conversions of this cycle done.
+			 * Disable the sensor immediately.
+			 * This keeps the sensor supply time exact,
+			 * regardless of the mainloop latency. */
+			sensor_disable(sensor.nr);
+			sensor.stat = STAT_ADC_DONE_P1;
+		}
+	}
+	/* else: The measurement was cancelled. Discard the result. */
+	mb();
+}
+
+/* Begin the ADC conversion(s) of one measurement phase.
+ * conv_stat: The ADC conversion state of the phase.
+ * count: The number of conversions.
+ */
+static void sensor_adc_begin(enum sensor_status conv_stat, uint8_t count)
+{
+	sensor.adc_sum = 0;
+	sensor.adc_count = count;
+	sensor.stat = conv_stat;
+	mb();
+	sensor_adc_start();
+}
+
+/* Adjust the tuned warmup time of the current sensor.
+ * This is called after a finished measurement with
+ * at least two measurement cycles.
+ */
+static void sensor_autotune(void)
+{
+	struct sensor_tuning *tuning = &sensor_tuning[sensor.nr];
+	uint16_t lo = UINT16_MAX, hi = 0, spread;
+	uint8_t i, max_warmup;
+
+	/* Get the spread of the measured values. */
+	for (i = 0; i < sensor.value_count; i++) {
+		lo = min(lo, sensor.values[i]);
+		hi = max(hi, sensor.values[i]);
+	}
+	spread = hi - lo;
+
+	max_warmup = msec_to_jiffies(sensor.conf.warmup_ms);
+	if (!tuning->warmup) {
+		/* This measurement ran with the configured warmup time.
+		 * Use its spread as reference. */
+		tuning->warmup = max_warmup;
+		tuning->spread_ref = spread;
+	}
+
+	if (spread > tuning->spread_ref +
+		     (SENSOR_AUTOTUNE_TOLERANCE << SENSOR_FILTER_FRACT_BITS)) {
+		/* The noise increased. Warmup is too short. */
+		tuning->warmup = min(tuning->warmup + SENSOR_AUTOTUNE_STEPUP,
+				     max_warmup);
+	} else if (tuning->warmup > 1) {
+		/* Try a shorter warmup. */
+		tuning->warmup--;
+	}
+}
+
+/* Start the supply voltage measurement.
+ * The sensors are disabled during this measurement.
+ */
+static void sensor_vcc_begin(void)
+{
+	ADMUX = SENSOR_ADMUX_BANDGAP;
+	/* Add one conversion for settling. */
+	sensor_adc_begin(STAT_VCC_CONV, SENSOR_VCC_SAMPLES + 1);
+}
+
 /* Start the warmup-cycle of the current sensor. */
 static void sensor_warmup_begin(void)
 {
 	/* Set the warmup-end time and set
 	 * warmup-polarity-0 state. */
-	sensor.timer = jiffies_get() + WARMUP_TIME;
+	sensor.timer = jiffies_get() + sensor.warmup;
 	sensor.stat = STAT_WARMUP_P0;
 	/* Enable the sensor with 0-polarity. */
 	sensor_enable(sensor.nr, 0);
 }
 
+/* Limit all values of a sensor configuration to the valid ranges.
+ * conf: The configuration to sanitize.
+ */
+static void sensor_config_sanitize(struct sensor_config *conf)
+{
+	if (conf->filter >= SENSOR_NR_FILTERS)
+		conf->filter = SENSOR_FILTER_MEDIAN;
+	conf->nr_cycles = clamp(conf->nr_cycles, 1, SENSOR_MAX_CYCLES);
+	conf->oversample = min(conf->oversample, SENSOR_MAX_OVERSAMPLE);
+	conf->warmup_ms = clamp(conf->warmup_ms,
+				SENSOR_MIN_WARMUP_MS, SENSOR_MAX_WARMUP_MS);
+	conf->wait_ms = min(conf->wait_ms, SENSOR_MAX_WAIT_MS);
+}
+
+/* Read the configuration of a sensor from the EEPROM.
+ * There is no RAM-copy of the configurations. They are only needed
+ * once per measurement, and RAM is scarce.
+ * The EEPROM content is not trusted. The result is sanitized.
+ * nr: The sensor number.
+ * conf: Pointer to the destination buffer.
+ */
+static void sensor_read_config(uint8_t nr, struct sensor_config *conf)
+{
+	eeprom_read_block_wdtsafe(conf, &eeprom_sensor_configs[nr],
+				  sizeof(*conf));
+	sensor_config_sanitize(conf);
+}
+
 /* Start a measurement on a sensor.
  * nr: The sensor number.
  */
@@ -230,23 +590,37 @@ void sensor_start(uint8_t nr)
 	/* Reset the stored values to zero. */
 	memset(sensor.values, 0, sizeof(sensor.values));
 	sensor.value_count = 0;
-	/* Store the sensor number. */
+	sensor.asym_sum = 0;
+	/* Store the sensor number and configuration. */
 	sensor.nr = nr;
-	/* Start the warmup sequence. */
-	sensor_warmup_begin();
+	sensor_read_config(nr, &sensor.conf);
+	/* Calculate the warmup and wait times. */
+	if (sensor_tuning[nr].warmup)
+		sensor.warmup = sensor_tuning[nr].warmup;
+	else
+		sensor.warmup = msec_to_jiffies(sensor.conf.warmup_ms);
+	sensor.wait = msec_to_jiffies(sensor.conf.wait_ms);
+	/* Measure the supply voltage.
+	 * This starts the warmup sequence afterwards. */
+	sensor_vcc_begin();
 }
 
 /* Cancel the currently running measurement. */
 void sensor_cancel(void)
 {
+	uint8_t sreg;
+
 	if (sensor.stat == STAT_IDLE)
 		return;
 
-	/* Wait for possibly running ADC to finish. */
-	while (!sensor_adc_done());
-	/* Disable the supplies and reset the state machine. */
+	/* Disable the supplies and reset the state machine.
+	 * A possibly running ADC conversion will be discarded
+	 * by the interrupt handler. */
+	sreg = irq_disable_save();
 	sensor_disable(sensor.nr);
+	ADMUX = SENSOR_ADMUX;
 	sensor.stat = STAT_IDLE;
+	irq_restore(sreg);
 }
 
 /* Returns 1, if no measurement is running.
@@ -266,8 +640,9 @@ bool sensors_idle(void)
 bool sensor_poll(struct sensor_result *res)
 {
 	jiffies_t now;
-	uint16_t a, b, c, median;
+	uint16_t value, value_p0, value_p1;
 
+	mb();
 	if (sensor.stat == STAT_IDLE) {
 		/* No measurement running. Return early. */
 		return 0;
@@ -280,6 +655,21 @@ bool sensor_poll(struct sensor_result *res)
 	switch (sensor.stat) {
 	case STAT_IDLE:
 		break;
+	case STAT_VCC_CONV:
+		/* Bandgap conversion not finished, yet. */
+		break;
+	case STAT_VCC_DONE:
+		/* Bandgap conversion done.
+		 * Calculate the supply voltage, switch the
+		 * multiplexer back to the sensor input
+		 * and start the warmup sequence. */
+		if (sensor.adc_sum) {
+			sensor_vcc_mv = (uint32_t)SENSOR_BANDGAP_MV * (SENSOR_MAX + 1) *
+					SENSOR_VCC_SAMPLES / sensor.adc_sum;
+		}
+		ADMUX = SENSOR_ADMUX;
+		sensor_warmup_begin();
+		break;
 	case STAT_WAIT:
 		if (time_before(now, sensor.timer)) {
 			/* Wait time not finished, yet. */
@@ -294,9 +684,15 @@ bool sensor_poll(struct sensor_result *res)
 			break;
 		}
 		/* Warmup with polarity 0 done.
+		 * Start ADC conversion(s). */
+		sensor_adc_begin(STAT_ADC_CONV_P0, 1 << sensor.conf.oversample);
+		break;
+	case STAT_ADC_DONE_P0:
+		/* ADC conversion with polarity 0 done.
+		 * The interrupt handler already switched to polarity 1.
 		 * Start warmup phase with polarity 1. */
-		sensor_enable(sensor.nr, 1);
-		sensor.timer = now + WARMUP_TIME;
+		sensor.adc_sum_p0 = sensor.adc_sum;
+		sensor.timer = now + sensor.warmup;
 		sensor.stat = STAT_WARMUP_P1;
 		break;
 	case STAT_WARMUP_P1:
@@ -305,40 +701,68 @@ bool sensor_poll(struct sensor_result *res)
 			break;
 		}
 		/* Warmup with polarity 1 done.
-		 * Start ADC conversion. */
-		sensor_adc_start();
-		sensor.stat = STAT_ADC_CONV;
+		 * Start ADC conversion(s). */
+		sensor_adc_begin(STAT_ADC_CONV_P1, 1 << sensor.conf.oversample);
 		break;
-	case STAT_ADC_CONV:
-		if (!sensor_adc_done()) {
-			/* ADC conversion not finised, yet. */
-			break;
-		}
-		/* ADC conversion done. Disable sensor. */
-		sensor_disable(sensor.nr);
-
-		/* Store the measured value. */
-		sensor.values[sensor.value_count] = sensor_adc_read_value();
+	case STAT_ADC_CONV_P0:
+	case STAT_ADC_CONV_P1:
+		/* ADC conversion not finished, yet.
+		 * The interrupt handler will switch to the DONE state. */
+		break;
+	case STAT_ADC_DONE_P1:
+		/* ADC conversion done.
+		 * The sensor was already disabled by the interrupt handler.
+		 * Decimate the oversampled conversions of both phases
+		 * into fixed point values.
+		 * The sum of up to 16 conversions fits into the 16 bit
+		 * fixed point representation with 6 fractional bits.
+		 */
+		build_assert(SENSOR_FILTER_FRACT_BITS >= SENSOR_MAX_OVERSAMPLE);
+		build_assert((uint32_t)SENSOR_MAX << SENSOR_FILTER_FRACT_BITS <= UINT16_MAX);
+		value_p1 = sensor.adc_sum << (SENSOR_FILTER_FRACT_BITS - sensor.conf.oversample);
+		value_p0 = sensor.adc_sum_p0 << (SENSOR_FILTER_FRACT_BITS - sensor.conf.oversample);
+
+		/* The voltage divider is mirrored with polarity 0.
+		 * Mirror the polarity 0 value back and combine both
+		 * into the average value.
+		 * Polarisation of the electrodes shifts the two values
+		 * in opposite directions, so it cancels out in
+		 * the average. The difference is the asymmetry.
+		 */
+		value_p0 = ((uint16_t)SENSOR_MAX << SENSOR_FILTER_FRACT_BITS) - value_p0;
+		value = ((uint32_t)value_p0 + value_p1) >> 1;
+		sensor.asym_sum += ((int32_t)value_p1 - (int32_t)value_p0)
+				   >> SENSOR_FILTER_FRACT_BITS;
+
+		sensor.values[sensor.value_count] = value;
 		sensor.value_count++;
 
-		if (sensor.value_count >= 3) {
-			/* All measurements done. */
-
-			a = sensor.values[0];
-			b = sensor.values[1];
-			c = sensor.values[2];
-
-			/* Get the median of all measurements.
-			 * 'b' will be the result. */
-			if (a > b)
-				swap_values(a, b);
-			if (b > c)
-				swap_values(b, c);
-			median = b;
-
-			/* Store the result. */
+		if (sensor.value_count >= sensor.conf.nr_cycles) {
+			/* All measurements done.
+			 * Tune the warmup time, if requested. */
+			if ((sensor.conf.flags & SENSOR_FLG_AUTOTUNE) &&
+			    sensor.value_count >= 2)
+				sensor_autotune();
+
+			/* Run the result filter. */
+			value = sensor_filter_apply(sensor.conf.filter,
+						    sensor.values,
+						    sensor.value_count,
+						    &sensor_iir[sensor.nr]);
+
+			/* Compensate supply voltage deviations. */
+			if (SENSOR_VCC_COMP && sensor_vcc_mv) {
+				value = min((uint32_t)value * sensor_vcc_mv /
+					    SENSOR_VCC_NOMINAL_MV,
+					    (uint32_t)SENSOR_MAX << SENSOR_FILTER_FRACT_BITS);
+			}
+
+			/* Store the result.
+			 * Round the fixed point value to ADC resolution. */
 			res->nr = sensor.nr;
-			res->value = median;
+			res->asymmetry = sensor.asym_sum / (int8_t)sensor.value_count;
+			res->value = (value + (1 << (SENSOR_FILTER_FRACT_BITS - 1)))
+				     >> SENSOR_FILTER_FRACT_BITS;
 			sensor.stat = STAT_IDLE;
 
 			/* Whole measurement done. */
@@ -346,7 +770,7 @@ bool sensor_poll(struct sensor_result *res)
 		} else {
 			/* Schedule the next measurement. */
 
-			sensor.timer = now + WAIT_TIME;
+			sensor.timer = now + sensor.wait;
 			sensor.stat = STAT_WAIT;
 		}
 		break;
@@ -356,25 +780,101 @@ bool sensor_poll(struct sensor_result *res)
 	return 0;
 }
 
+/* Get the configuration of a sensor.
+ * nr: The sensor number.
+ * dest: Pointer to the destination buffer.
+ */
+void sensor_get_config(uint8_t nr, struct sensor_config *dest)
+{
+	if (nr >= SENSOR_COUNT)
+		return;
+	sensor_read_config(nr, dest);
+}
+
+/* Set a new sensor configuration.
+ * The new configuration is sanitized, activated
+ * and written to the EEPROM.
+ * The new configuration applies to the next measurement.
+ * nr: The sensor number.
+ * src: Pointer to the new configuration.
+ */
+void sensor_update_config(uint8_t nr, const struct sensor_config *src)
+{
+	struct sensor_config conf;
+
+	if (nr >= SENSOR_COUNT)
+		return;
+
+	conf = *src;
+	sensor_config_sanitize(&conf);
+
+	/* Restart the IIR filter and the warmup tuning. */
+	sensor_iir[nr].valid = 0;
+	sensor_tuning[nr].warmup = 0;
+
+	eeprom_update_block_wdtsafe(&conf, &eeprom_sensor_configs[nr],
+				    sizeof(conf));
+}
+
+/* Get the current warmup time of a sensor.
+ * This is the auto-tuned warmup time, if auto-tuning is active.
+ * Returns the time in milliseconds.
+ * nr: The sensor number.
+ */
+uint16_t sensor_get_tuned_warmup(uint8_t nr)
+{
+	struct sensor_config conf;
+
+	if (nr >= SENSOR_COUNT)
+		return 0;
+	sensor_read_config(nr, &conf);
+	if (sensor_tuning[nr].warmup &&
+	    (conf.flags & SENSOR_FLG_AUTOTUNE))
+		return (uint16_t)sensor_tuning[nr].warmup * (1000 / JPS);
+	return conf.warmup_ms;
+}
+
+/* Get the last measured supply voltage.
+ * Returns the voltage in millivolts, or zero if unknown.
+ */
+uint16_t sensor_get_vcc(void)
+{
+	return sensor_vcc_mv;
+}
+
 /* Initialize the sensor unit. */
 void sensor_init(void)
 {
 	uint8_t nr;
 
+	build_assert(ARRAY_SIZE(sensor_a_bit) == SENSOR_COUNT);
 	build_assert(ARRAY_SIZE(sensor_a_bit) == ARRAY_SIZE(sensor_a_ddr));
 	build_assert(ARRAY_SIZE(sensor_a_bit) == ARRAY_SIZE(sensor_a_port));
 
 	/* Reset the sensor context. */
 	memset(&sensor, 0, sizeof(sensor));
+	memset(sensor_iir, 0, sizeof(sensor_iir));
+	memset(sensor_tuning, 0, sizeof(sensor_tuning));
+	sensor_vcc_mv = 0;
 
 	/* Disable all sensors. */
 	for (nr = 0; nr < SENSOR_COUNT; nr++)
 		sensor_disable(nr);
 
+	/* Initialize ADC to 125 kHz (on 16 MHz CPU).
+	 * Select AVcc reference.
+	 * Set multiplexer to ADC0.
+	 * Enable the conversion-complete interrupt.
+	 */
+	build_assert(F_CPU == 16000000ul);
+	ADMUX = SENSOR_ADMUX;
+	ADCSRA = (1 << ADEN) | (1 << ADIE) |
+		 (1 << ADPS0) | (1 << ADPS1) | (1 << ADPS2);
+
 	/* Perform one ADC conversion, as per AtMega datasheet the
 	 * very first conversion has less precision.
-	 * Discard the result.
+	 * The state machine is idle, so the interrupt handler
+	 * will discard the result.
 	 */
-	sensor_adc_start();
-	while (!sensor_adc_done());
+	ADCSRA |= (1 << ADSC);
 }
@@ -2,27 +2,123 @@
 #define SENSOR_H_
 
 #include "util.h"
+#include "sensor_filter.h"
 
 #include <stdint.h>
 
 
+/* The number of available sensors. */
+#define SENSOR_COUNT		6
+
+/* The maximum number of warmup/measurement cycles. */
+#define SENSOR_MAX_CYCLES	8
+/* The maximum log2 of the number of ADC conversions per cycle. */
+#define SENSOR_MAX_OVERSAMPLE	4
+/* The warmup time limits, in milliseconds. */
+#define SENSOR_MIN_WARMUP_MS	5
+#define SENSOR_MAX_WARMUP_MS	1000
+/* The maximum wait time, in milliseconds. */
+#define SENSOR_MAX_WAIT_MS	10000
+
+enum sensor_config_flags {
+	/* Automatically shorten the warmup time. */
+	SENSOR_FLG_AUTOTUNE	= 1 << 0,
+};
+
+/* Sensor configuration. */
+struct sensor_config {
+	/* The measurement result filter.
+	 * See 'enum sensor_filter_type'. */
+	uint8_t filter;
+	/* The number of warmup/measurement cycles.
+	 * 1 - SENSOR_MAX_CYCLES */
+	uint8_t nr_cycles;
+	/* The number of ADC conversions per measurement cycle,
+	 * as power of two exponent. 0 - SENSOR_MAX_OVERSAMPLE */
+	uint8_t oversample;
+	/* The warmup time per supply polarity, in milliseconds.
+	 * SENSOR_MIN_WARMUP_MS - SENSOR_MAX_WARMUP_MS */
+	uint16_t warmup_ms;
+	/* The wait time between the measurement cycles,
+	 * in milliseconds. 0 - SENSOR_MAX_WAIT_MS */
+	uint16_t wait_ms;
+	/* Configuration flags. See 'enum sensor_config_flags'. */
+	uint8_t flags;
+} _packed;
+
 /* Measurement result. */
 struct sensor_result {
 	/* The number of the sensor this result belongs to. */
 	uint8_t nr;
-	/* The raw ADC value of the measurement. */
+	/* The raw ADC value of the measurement.
+	 * This is the average of both supply polarities. */
 	uint16_t value;
+	/* The difference between the polarity 1 and the
+	 * polarity 0 ADC value. This is a polarisation diagnostic. */
+	int16_t asymmetry;
 };
 
 /* The largest sensor ADC value. */
 #define SENSOR_MAX	0x3FF
 
+/* Raw ADC streaming:
+ *		If enabled, every single ADC conversion can be
+ *		recorded for transmission to the host.
+ *		The serial link carries about 210 samples per second
+ *		(two samples per 18 byte frame at 19200 baud).
+ *		The oversampled conversions of a measurement run at
+ *		kHz rates, so the stream has to be restricted to one
+ *		sensor and decimated to get a capture without gaps.
+ *		The sample FIFO costs about 40 bytes of RAM, so this is
+ *		disabled by default. Add -DSENSOR_STREAM=1 to the
+ *		Makefile CFLAGS for a characterisation build.
+ */
+#ifndef SENSOR_STREAM
+# define SENSOR_STREAM		0
+#endif
+
+/* Raw ADC stream sample. */
+struct sensor_stream_sample {
+	/* The lower 16 bits of the jiffies count of the conversion. */
+	uint16_t jiffies;
+	/* Bits 0-9:   The raw ADC value.
+	 * Bit 10:     The supply polarity.
+	 * Bits 11-13: The sensor number.
+	 * Bit 15:     Samples were lost before this sample. */
+	uint16_t data;
+} _packed;
+
+#define SENSOR_STREAM_DATA(nr, polarity, value)	\
+	((uint16_t)(value) |			\
+	 ((uint16_t)!!(polarity) << 10) |	\
+	 ((uint16_t)((nr) & 7) << 11))
+#define SENSOR_STREAM_LOST	((uint16_t)1 << 15)
+
 void sensor_start(uint8_t nr);
 void sensor_cancel(void);
 bool sensor_poll(struct sensor_result *res);
 
 bool sensors_idle(void);
 
+void sensor_get_config(uint8_t nr, struct sensor_config *dest);
+void sensor_update_config(uint8_t nr, const struct sensor_config *src);
+uint16_t sensor_get_tuned_warmup(uint8_t nr);
+uint16_t sensor_get_vcc(void);
+
+#if SENSOR_STREAM
+void sensor_stream_enable(bool enable, uint8_t sensor_mask,
+			  uint8_t decimation);
+bool sensor_stream_enabled(void);
+uint8_t sensor_stream_pop(struct sensor_stream_sample *samples,
+			  uint8_t max_count);
+#else
+static inline void sensor_stream_enable(bool enable, uint8_t sensor_mask,
+					uint8_t decimation) { }
+static inline bool sensor_stream_enabled(void) { return 0; }
+static inline uint8_t sensor_stream_pop(struct sensor_stream_sample *samples,
+					uint8_t max_count) { return 0; }
+#endif
+
 void sensor_init(void);
 
 #endif /* SENSOR_H_ */
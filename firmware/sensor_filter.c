@@ -0,0 +1,142 @@
+/*
+ * Moistcontrol - sensor result filters
+ *
+ * Copyright (c) 2013 Michael Buesch <m@bues.ch>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "sensor_filter.h"
+
+
+/* Compile-time filter selection:
+ *		If SENSOR_FILTER_ONLY is defined to one of the
+ *		'enum sensor_filter_type' values, the runtime filter
+ *		selection is ignored and all other filters are
+ *		optimized out of the program.
+ */
+#ifdef SENSOR_FILTER_ONLY
+# define filter_enabled(type)	((type) == SENSOR_FILTER_ONLY)
+#else
+# define filter_enabled(type)	1
+#endif
+
+/* IIR low-pass filter coefficient.
+ * The filter is:  y = y + (x - y) / (2 ^ SENSOR_IIR_SHIFT)
+ */
+#ifndef SENSOR_IIR_SHIFT
+# define SENSOR_IIR_SHIFT	2
+#endif
+
+
+/* Sort an array of samples in ascending order.
+ * Insertion sort. The arrays are tiny.
+ */
+static void sort_samples(uint16_t *samples, uint8_t count)
+{
+	uint8_t i, j;
+	uint16_t tmp;
+
+	for (i = 1; i < count; i++) {
+		tmp = samples[i];
+		for (j = i; j > 0 && samples[j - 1] > tmp; j--)
+			samples[j] = samples[j - 1];
+		samples[j] = tmp;
+	}
+}
+
+/* Calculate the rounded mean of 'count' samples. */
+static uint16_t mean(const uint16_t *samples, uint8_t count)
+{
+	uint32_t sum = 0;
+	uint8_t i;
+
+	for (i = 0; i < count; i++)
+		sum += samples[i];
+
+	return div_round(sum, (uint32_t)count);
+}
+
+/* Median filter.
+ * samples must be sorted.
+ */
+static uint16_t filter_median(const uint16_t *samples, uint8_t count)
+{
+	uint8_t mid = count / 2;
+
+	if (count & 1)
+		return samples[mid];
+	/* Even number of samples. Use the mean of the middle two. */
+	return mean(&samples[mid - 1], 2);
+}
+
+/* Trimmed mean filter.
+ * Discards the lowest and highest quarter of the samples.
+ * samples must be sorted.
+ */
+static uint16_t filter_trimmed_mean(const uint16_t *samples, uint8_t count)
+{
+	uint8_t trim = (count + 1) / 4;
+
+	return mean(&samples[trim], count - (2 * trim));
+}
+
+/* IIR low-pass filter.
+ * The mean of the samples is fed into the filter.
+ */
+static uint16_t filter_iir(const uint16_t *samples, uint8_t count,
+			   struct sensor_filter_iir *iir)
+{
+	uint16_t value = mean(samples, count);
+	int32_t diff;
+
+	if (iir->valid) {
+		diff = (int32_t)value - (int32_t)iir->value;
+		iir->value = (int32_t)iir->value + (diff / (1 << SENSOR_IIR_SHIFT));
+	} else {
+		/* First value. Seed the filter. */
+		iir->value = value;
+		iir->valid = 1;
+	}
+
+	return iir->value;
+}
+
+/* Run a filter on a set of samples.
+ * type: The filter type. See 'enum sensor_filter_type'.
+ * samples: The samples. The array will be sorted in place.
+ * count: The number of samples. Must be at least 1.
+ * iir: The IIR filter state of the sensor.
+ * Returns the filtered value.
+ */
+uint16_t sensor_filter_apply(uint8_t type,
+			     uint16_t *samples, uint8_t count,
+			     struct sensor_filter_iir *iir)
+{
+#ifdef SENSOR_FILTER_ONLY
+	type = SENSOR_FILTER_ONLY;
+#endif
+
+	if (filter_enabled(SENSOR_FILTER_IIR) &&
+	    type == SENSOR_FILTER_IIR)
+		return filter_iir(samples, count, iir);
+
+	sort_samples(samples, count);
+	if (filter_enabled(SENSOR_FILTER_TRIMMEDMEAN) &&
+	    type == SENSOR_FILTER_TRIMMEDMEAN)
+		return filter_trimmed_mean(samples, count);
+
+	return filter_median(samples, count);
+}
@@ -0,0 +1,34 @@
+#ifndef SENSOR_FILTER_H_
+#define SENSOR_FILTER_H_
+
+#include "util.h"
+
+#include <stdint.h>
+
+
+/* Sensor measurement result filter types. */
+enum sensor_filter_type {
+	SENSOR_FILTER_MEDIAN,		/* Median of all samples. */
+	SENSOR_FILTER_TRIMMEDMEAN,	/* Mean without the outer quartiles. */
+	SENSOR_FILTER_IIR,		/* Mean, IIR low-pass filtered
+					 * over consecutive measurements. */
+
+	SENSOR_NR_FILTERS,
+};
+
+/* Number of fractional bits in the fixed point sample values. */
+#define SENSOR_FILTER_FRACT_BITS	6
+
+/* IIR low-pass filter state. */
+struct sensor_filter_iir {
+	/* The current filter output value. */
+	uint16_t value;
+	/* The filter has been seeded with a value. */
+	bool valid;
+};
+
+uint16_t sensor_filter_apply(uint8_t type,
+			     uint16_t *samples, uint8_t count,
+			     struct sensor_filter_iir *iir);
+
+#endif /* SENSOR_FILTER_H_ */
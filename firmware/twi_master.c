@@ -21,6 +21,7 @@
 #include "twi_master.h"
 #include "twi_master_sync.h"
 #include "util.h"
+#include "main.h"
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
@@ -33,13 +34,30 @@
 # warning "No TWI_SCL_HZ defined. Defaulting to 100 KHz."
 # define TWI_SCL_HZ	100000ul
 #endif
+#ifndef TWI_FAST_SCL_HZ
+# define TWI_FAST_SCL_HZ	400000ul
+#endif
 
-#define TWI_SYNC
+/* Bit rate register values. The prescaler is 1 for all speeds.
+ * The TWI needs TWBR >= 10 for stable operation. */
+#define TWI_TWBR(scl_hz)	(((F_CPU / (scl_hz)) - 16) / 2)
+#define TWI_TWBR_STD		TWI_TWBR(TWI_SCL_HZ)
+#define TWI_TWBR_FAST		TWI_TWBR(TWI_FAST_SCL_HZ)
 
+/* Timeout of a single transfer on the bus, in milliseconds. */
+#define TWI_TIMEOUT_MS	50
+
+/* Port definitions of the TWI bus lines. */
+#define TWI_PORT	PORTC
+#define TWI_DDR		DDRC
+#define TWI_PIN		PINC
+#define TWI_SDA_BIT	PC4
+#define TWI_SCL_BIT	PC5
+/* Half of the SCL period for the bus clear sequence, in microseconds. */
+#define TWI_BUSCLEAR_US	((500000ul + TWI_SCL_HZ - 1) / TWI_SCL_HZ)
 
-enum twi_transfer_status_flags {
-	TWI_XFER_READ		= 0x80,
 
+enum twi_transfer_status_flags {
 	TWI_XFER_STAT_MASK	= 0x0F,
 	TWI_XFER_STAT_SHIFT	= 0,
 };
@@ -47,11 +65,38 @@ enum twi_transfer_status_flags {
 struct twi_context {
 	struct twi_transfer *first_xfer;
 	struct twi_transfer *last_xfer;
+	struct twi_segment seg;		/* The current segment of first_xfer. */
+	uint8_t timeout;		/* Timeout of first_xfer, in jiffies. */
+	bool recover;			/* The bus needs a recovery. */
+	struct twi_stats stats;		/* Error counters. */
 };
 
 static struct twi_context twi;
 
 
+static void count_event(uint16_t *counter)
+{
+	/* Saturating increment. */
+	if (*counter != 0xFFFF)
+		(*counter)++;
+}
+
+
+static uint8_t get_twbr(const struct twi_transfer *xfer)
+{
+	build_assert(TWI_TWBR_FAST >= 10 && TWI_TWBR_FAST <= 0xFF);
+	build_assert(TWI_TWBR_STD >= 10 && TWI_TWBR_STD <= 0xFF);
+
+	if (xfer->speed == TWI_SPEED_FAST)
+		return TWI_TWBR_FAST;
+	return TWI_TWBR_STD;
+}
+
+static void set_speed(const struct twi_transfer *xfer)
+{
+	TWBR = get_twbr(xfer);
+}
+
 static inline void TWCR_write(uint8_t additional_flags)
 {
 	mb();
@@ -70,6 +115,69 @@ static void send_stop_condition(void)
 	TWCR_write(1 << TWSTO);
 }
 
+static void send_stop_start_condition(void)
+{
+	/* Send stop condition, followed by a start condition. */
+	TWCR_write((1 << TWIE) | (1 << TWSTO) | (1 << TWSTA));
+}
+
+static void bus_clear(void)
+{
+	uint8_t i;
+
+	/* Disable the TWI module and drive the bus lines manually.
+	 * A line is pulled low by switching it to output-low
+	 * and released by switching it to input. */
+	TWCR = 0;
+	mb();
+	TWI_PORT &= ~((1 << TWI_SDA_BIT) | (1 << TWI_SCL_BIT));
+	TWI_DDR &= ~((1 << TWI_SDA_BIT) | (1 << TWI_SCL_BIT));
+	_delay_us(TWI_BUSCLEAR_US);
+
+	/* A slave that was interrupted in the middle of a byte
+	 * might hold SDA low. Clock SCL up to nine times,
+	 * until it releases SDA. */
+	for (i = 0; i < 9; i++) {
+		if (TWI_PIN & (1 << TWI_SDA_BIT))
+			break;
+		TWI_DDR |= (1 << TWI_SCL_BIT);
+		_delay_us(TWI_BUSCLEAR_US);
+		TWI_DDR &= ~(1 << TWI_SCL_BIT);
+		_delay_us(TWI_BUSCLEAR_US);
+	}
+
+	/* Send a stop condition: SDA rises while SCL is high. */
+	TWI_DDR |= (1 << TWI_SCL_BIT);
+	_delay_us(TWI_BUSCLEAR_US);
+	TWI_DDR |= (1 << TWI_SDA_BIT);
+	_delay_us(TWI_BUSCLEAR_US);
+	TWI_DDR &= ~(1 << TWI_SCL_BIT);
+	_delay_us(TWI_BUSCLEAR_US);
+	TWI_DDR &= ~(1 << TWI_SDA_BIT);
+	_delay_us(TWI_BUSCLEAR_US);
+}
+
+static void setup_hardware(void)
+{
+#if TWI_SYNC
+	i2c_init();
+#else
+	TWSR = 0;
+	TWBR = TWI_TWBR_STD;
+	TWAR = 0;
+	TWCR = (1 << TWEN);
+#endif
+}
+
+static void reset_hardware(void)
+{
+	/* Free the bus and re-initialize the TWI module.
+	 * This aborts any running operation. */
+	bus_clear();
+	setup_hardware();
+	count_event(&twi.stats.recoveries);
+}
+
 static void transfer_set_status(struct twi_transfer *xfer,
 				enum twi_status status)
 {
@@ -82,26 +190,126 @@ static enum twi_status transfer_get_status(const struct twi_transfer *xfer)
 	return (xfer->status & TWI_XFER_STAT_MASK) >> TWI_XFER_STAT_SHIFT;
 }
 
-static void stop_transfer(struct twi_transfer *xfer,
-			  enum twi_status new_status)
+/* Load the current segment of a transfer into "seg".
+ * A simple transfer consists of a write segment,
+ * followed by a read segment. Empty segments are skipped.
+ * Returns 0, if there are no more segments.
+ */
+static bool load_segment(struct twi_transfer *xfer,
+			 struct twi_segment *seg)
+{
+	while (1) {
+		if (xfer->nr_segments) {
+			if (xfer->segment >= xfer->nr_segments)
+				return 0;
+			*seg = xfer->segments[xfer->segment];
+		} else {
+			seg->buffer = xfer->buffer;
+			seg->address = xfer->address;
+			if (xfer->segment == 0) {
+				seg->size = xfer->write_size;
+				seg->flags = 0;
+			} else if (xfer->segment == 1) {
+				seg->size = xfer->read_size;
+				seg->flags = TWI_SEG_READ;
+			} else
+				return 0;
+		}
+		if (seg->size)
+			return 1;
+		xfer->segment++;
+	}
+}
+
+/* Advance to the next segment of a transfer.
+ * Returns 0, if there are no more segments.
+ */
+static bool next_segment(struct twi_transfer *xfer)
+{
+	xfer->segment++;
+	xfer->offset = 0;
+
+	return load_segment(xfer, &twi.seg);
+}
+
+static void complete_transfer(struct twi_transfer *xfer,
+			      enum twi_status new_status)
 {
-	send_stop_condition();
+	if (new_status == TWI_STAT_BUSERROR)
+		count_event(&twi.stats.errors);
+	else if (new_status == TWI_STAT_TIMEOUT)
+		count_event(&twi.stats.timeouts);
 
 	transfer_set_status(xfer, new_status);
+	if (xfer->callback)
+		xfer->callback(xfer, new_status);
+}
 
+static void stop_transfer(struct twi_transfer *xfer,
+			  enum twi_status new_status)
+{
 	twi.first_xfer = xfer->next;
-	if (twi.first_xfer)
-		send_start_condition();
-	else
+	if (twi.first_xfer) {
+		twi.timeout = msec_to_jiffies(TWI_TIMEOUT_MS);
+		load_segment(twi.first_xfer, &twi.seg);
+		/* The stop condition ends this transfer and the start
+		 * condition begins the next one. Time both for the
+		 * slower bus clock of the two transfers. */
+		TWBR = max(TWBR, get_twbr(twi.first_xfer));
+		send_stop_start_condition();
+	} else {
 		twi.last_xfer = NULL;
+		send_stop_condition();
+	}
 
-	if (xfer->callback)
-		xfer->callback(xfer, new_status);
+	complete_transfer(xfer, new_status);
+}
+
+static void abort_transfer(struct twi_transfer *xfer,
+			   enum twi_status new_status)
+{
+	struct twi_transfer *prev;
+
+	if (xfer == twi.first_xfer) {
+		/* This transfer is on the bus. The hardware might be
+		 * stuck. Stop the TWI module. The bus clear is too slow
+		 * for interrupt context, so twi_work() recovers the bus
+		 * and starts the next transfer. */
+		TWCR = 0;
+		twi.recover = 1;
+		twi.timeout = 0;
+		twi.first_xfer = xfer->next;
+		if (!twi.first_xfer)
+			twi.last_xfer = NULL;
+	} else {
+		/* This transfer is queued. Unlink it. */
+		for (prev = twi.first_xfer; prev; prev = prev->next) {
+			if (prev->next == xfer)
+				break;
+		}
+		if (!prev)
+			return;
+		prev->next = xfer->next;
+		if (twi.last_xfer == xfer)
+			twi.last_xfer = prev;
+	}
+
+	complete_transfer(xfer, new_status);
+}
+
+static void ack_next_byte(struct twi_transfer *xfer)
+{
+	/* NACK the last byte of the segment. */
+	if (xfer->offset + 1 == twi.seg.size)
+		TWCR_write(1 << TWIE);
+	else
+		TWCR_write((1 << TWIE) | (1 << TWEA));
 }
 
 static void handle_tw_status(struct twi_transfer *xfer, uint8_t twstat)
 {
-	uint8_t *buffer = xfer->buffer;
+	struct twi_segment *seg = &twi.seg;
+	uint8_t *buffer;
 
 	switch (twstat) {
 	default:
@@ -109,46 +317,48 @@ static void handle_tw_status(struct twi_transfer *xfer, uint8_t twstat)
 		break;
 	case TW_START:
 	case TW_REP_START:
-		if (xfer->status & TWI_XFER_READ)
-			TWDR = (xfer->address << 1) | 1;
+		/* The start condition after a stop condition may be timed
+		 * for the previous transfer. Switch to the bus clock of
+		 * this transfer before sending the address. */
+		set_speed(xfer);
+		if (seg->flags & TWI_SEG_READ)
+			TWDR = (seg->address << 1) | 1;
 		else
-			TWDR = (xfer->address << 1);
+			TWDR = (seg->address << 1);
 		TWCR_write(1 << TWIE);
 		break;
-	case TW_MT_DATA_ACK:
-	case TW_MR_DATA_ACK:
-	case TW_MR_DATA_NACK:
 	case TW_MT_SLA_ACK:
-		if (xfer->status & TWI_XFER_READ) {
-			buffer[xfer->offset++] = TWDR;
-
-			if (xfer->offset == xfer->read_size) {
+	case TW_MT_DATA_ACK:
+		if (xfer->offset == seg->size) {
+			if (!next_segment(xfer)) {
 				stop_transfer(xfer, TWI_STAT_FINISHED);
-			} else {
-				if (xfer->offset + 1 == xfer->read_size)
-					TWCR_write(1 << TWIE);
-				else
-					TWCR_write((1 << TWIE) | (1 << TWEA));
+				break;
 			}
-		} else {
-			if (xfer->offset == xfer->write_size) {
-				if (xfer->read_size) {
-					xfer->status |= TWI_XFER_READ;
-					xfer->offset = 0;
-					send_start_condition();
-				} else
-					stop_transfer(xfer, TWI_STAT_FINISHED);
-			} else {
-				TWDR = buffer[xfer->offset++];
-				TWCR_write(1 << TWIE);
+			if ((seg->flags & TWI_SEG_READ) ||
+			    !(seg->flags & TWI_SEG_NOSTART)) {
+				send_start_condition();
+				break;
 			}
+			/* Continue writing the next segment. */
 		}
+		buffer = seg->buffer;
+		TWDR = buffer[xfer->offset++];
+		TWCR_write(1 << TWIE);
 		break;
 	case TW_MR_SLA_ACK:
-		if (xfer->offset + 1 == xfer->read_size)
-			TWCR_write(1 << TWIE);
-		else
-			TWCR_write((1 << TWIE) | (1 << TWEA));
+		ack_next_byte(xfer);
+		break;
+	case TW_MR_DATA_ACK:
+	case TW_MR_DATA_NACK:
+		buffer = seg->buffer;
+		buffer[xfer->offset++] = TWDR;
+		if (xfer->offset == seg->size) {
+			if (next_segment(xfer))
+				send_start_condition();
+			else
+				stop_transfer(xfer, TWI_STAT_FINISHED);
+		} else
+			ack_next_byte(xfer);
 		break;
 	}
 }
@@ -171,62 +381,152 @@ ISR(TWI_vect)
 	twi_interrupt_handler();
 }
 
+/* Must be called on every system timer tick.
+ * Aborts the transfer on the bus, if it did not finish in time.
+ */
+void twi_systimer_tick(void)
+{
+#if !TWI_SYNC
+	struct twi_transfer *xfer;
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	xfer = twi.first_xfer;
+	if (xfer && twi.timeout) {
+		if (--twi.timeout == 0)
+			abort_transfer(xfer, TWI_STAT_TIMEOUT);
+	}
+	irq_restore(sreg);
+#endif
+}
+
+/* Must be called from the mainloop.
+ * Recovers the bus after an aborted transfer
+ * and restarts the transfer queue.
+ */
+void twi_work(void)
+{
+#if !TWI_SYNC
+	bool recover;
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	recover = twi.recover;
+	irq_restore(sreg);
+	if (!recover)
+		return;
+
+	/* The TWI module is stopped. Clear the bus
+	 * with interrupts enabled. */
+	reset_hardware();
+
+	sreg = irq_disable_save();
+	twi.recover = 0;
+	if (twi.first_xfer) {
+		twi.timeout = msec_to_jiffies(TWI_TIMEOUT_MS);
+		load_segment(twi.first_xfer, &twi.seg);
+		set_speed(twi.first_xfer);
+		send_start_condition();
+	}
+	irq_restore(sreg);
+#endif
+}
+
+/* Get a copy of the error counters. */
+void twi_get_stats(struct twi_stats *stats)
+{
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	*stats = twi.stats;
+	irq_restore(sreg);
+}
+
 void twi_init(void)
 {
-#ifdef TWI_SYNC
-	i2c_init();
-#else
 	memset(&twi, 0, sizeof(twi));
-	TWSR = 0;
-	TWBR = ((F_CPU / TWI_SCL_HZ) - 16) / 2;
-	TWAR = 0;
-#endif
+	/* A slave might still hold the bus from before our reset. */
+	bus_clear();
+	setup_hardware();
 }
 
 void twi_transfer(struct twi_transfer *xfer)
 {
-#ifdef TWI_SYNC
+#if TWI_SYNC
+	struct twi_segment seg;
 	twi_size_t i;
-	uint8_t *buffer = xfer->buffer;
-
-	if (xfer->write_size) {
-		i2c_start(xfer->address << 1);
-		for (i = 0; i < xfer->write_size; i++)
-			i2c_write(buffer[i]);
-		if (!xfer->read_size)
-			i2c_stop();
-	}
-	if (xfer->read_size) {
-		i2c_start((xfer->address << 1) | 1);
-		for (i = 0; i < xfer->read_size; i++) {
-			if (i + 1 == xfer->read_size)
-				buffer[i] = i2c_readNak();
-			else
-				buffer[i] = i2c_readAck();
+	uint8_t *buffer;
+	bool started = 0, error = 0;
+
+	set_speed(xfer);
+	xfer->segment = 0;
+	while (!error && load_segment(xfer, &seg)) {
+		buffer = seg.buffer;
+		if (seg.flags & TWI_SEG_READ) {
+			error |= i2c_start((seg.address << 1) | 1);
+			for (i = 0; i < seg.size && !error; i++) {
+				if (i + 1 == seg.size)
+					error |= i2c_readNak(&buffer[i]);
+				else
+					error |= i2c_readAck(&buffer[i]);
+			}
+		} else {
+			if (!started || !(seg.flags & TWI_SEG_NOSTART))
+				error |= i2c_start(seg.address << 1);
+			for (i = 0; i < seg.size && !error; i++)
+				error |= i2c_write(buffer[i]);
 		}
-		i2c_stop();
+		started = 1;
+		xfer->segment++;
 	}
-	if (xfer->callback)
-		xfer->callback(xfer, TWI_STAT_FINISHED);
+	if (started)
+		i2c_stop();
+	if (error)
+		reset_hardware();
+
+	complete_transfer(xfer, error ? TWI_STAT_BUSERROR
+				      : TWI_STAT_FINISHED);
 
 #else /* TWI_SYNC */
 
+	struct twi_segment seg;
 	uint8_t sreg;
 
+	sreg = irq_disable_save();
+
+	if (transfer_get_status(xfer) == TWI_STAT_INPROGRESS) {
+		/* This transfer still is queued. Re-queueing it
+		 * would corrupt the queue. */
+		irq_restore(sreg);
+		return;
+	}
+
 	xfer->offset = 0;
+	xfer->segment = 0;
 	xfer->next = NULL;
 	xfer->status = 0;
-	if (!xfer->write_size)
-		xfer->status |= TWI_XFER_READ;
-	transfer_set_status(xfer, TWI_STAT_INPROGRESS);
 
-	sreg = irq_disable_save();
+	if (!load_segment(xfer, &seg)) {
+		/* Nothing to transfer. */
+		complete_transfer(xfer, TWI_STAT_FINISHED);
+		irq_restore(sreg);
+		return;
+	}
+	transfer_set_status(xfer, TWI_STAT_INPROGRESS);
 
 	if (twi.last_xfer)
 		twi.last_xfer->next = xfer;
 	twi.last_xfer = xfer;
 	if (!twi.first_xfer) {
 		twi.first_xfer = xfer;
+		if (twi.recover) {
+			/* twi_work() starts the transfer. */
+			irq_restore(sreg);
+			return;
+		}
+		twi.seg = seg;
+		twi.timeout = msec_to_jiffies(TWI_TIMEOUT_MS);
+		set_speed(xfer);
 		send_start_condition();
 	}
 	irq_restore(sreg);
@@ -238,10 +538,6 @@ enum twi_status twi_transfer_get_status(const struct twi_transfer *xfer)
 	enum twi_status status;
 	uint8_t sreg;
 
-#ifdef TWI_SYNC
-	return TWI_STAT_FINISHED;
-#endif
-
 	sreg = irq_disable_save();
 	status = transfer_get_status(xfer);
 	irq_restore(sreg);
@@ -249,26 +545,48 @@ enum twi_status twi_transfer_get_status(const struct twi_transfer *xfer)
 	return status;
 }
 
+static void transfer_cancel(struct twi_transfer *xfer,
+			    enum twi_status new_status)
+{
+	uint8_t sreg;
+
+	sreg = irq_disable_save();
+	if (transfer_get_status(xfer) == TWI_STAT_INPROGRESS)
+		abort_transfer(xfer, new_status);
+	irq_restore(sreg);
+}
+
 enum twi_status twi_transfer_wait(struct twi_transfer *xfer,
 				  uint16_t timeout_ms)
 {
 	enum twi_status status;
-	uint32_t timeout = (uint32_t)timeout_ms * 100;
+	jiffies_t deadline = jiffies_get() + msec_to_jiffies(timeout_ms);
+	uint32_t polls = (uint32_t)timeout_ms * 100;
 
 	while (1) {
+		/* The mainloop is blocked. Run the bus recovery here. */
+		twi_work();
 		status = twi_transfer_get_status(xfer);
 		if (status != TWI_STAT_INPROGRESS)
 			break;
-		if (timeout-- == 0) {
-			twi_transfer_cancel(xfer);
-			status = TWI_STAT_TIMEOUT;
-			break;
-		}
-		_delay_us(10);
-		if (!irqs_enabled()) {
-			if (TWCR & (1 << TWINT))
-				twi_interrupt_handler();
+		if (irqs_enabled()) {
+			/* The system timer is running. */
+			if (time_before(jiffies_get(), deadline))
+				continue;
+		} else {
+			/* Interrupts are disabled. Poll the hardware
+			 * and count the polls instead of the time. */
+			if (polls) {
+				polls--;
+				_delay_us(10);
+				if (TWCR & (1 << TWINT))
+					twi_interrupt_handler();
+				continue;
+			}
 		}
+		transfer_cancel(xfer, TWI_STAT_TIMEOUT);
+		status = TWI_STAT_TIMEOUT;
+		break;
 	}
 
 	return status;
@@ -276,14 +594,5 @@ enum twi_status twi_transfer_wait(struct twi_transfer *xfer,
 
 void twi_transfer_cancel(struct twi_transfer *xfer)
 {
-	uint8_t sreg;
-
-#ifdef TWI_SYNC
-	return;
-#endif
-
-	sreg = irq_disable_save();
-	if (transfer_get_status(xfer) == TWI_STAT_INPROGRESS)
-		stop_transfer(xfer, TWI_STAT_CANCELLED);
-	irq_restore(sreg);
+	transfer_cancel(xfer, TWI_STAT_CANCELLED);
 }
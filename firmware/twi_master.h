@@ -7,6 +7,13 @@
 #include "util.h"
 
 
+/* Use the blocking polled implementation instead of
+ * the interrupt driven transfer queue. */
+#ifndef TWI_SYNC
+# define TWI_SYNC	0
+#endif
+
+
 struct twi_transfer;
 
 enum twi_status {
@@ -26,22 +33,65 @@ typedef uint8_t twi_size_t;
 
 typedef void (*twi_callback_t)(struct twi_transfer *, enum twi_status);
 
+/* Bus clock of a transfer.
+ * Fast mode should only be used, if all devices on the bus
+ * tolerate fast mode traffic.
+ */
+enum twi_speed {
+	TWI_SPEED_STD = 0,		/* TWI_SCL_HZ (100 kHz) */
+	TWI_SPEED_FAST,			/* TWI_FAST_SCL_HZ (400 kHz) */
+};
+
+enum twi_segment_flags {
+	TWI_SEG_READ		= 0x01,	/* Read into the buffer. */
+	TWI_SEG_NOSTART		= 0x02,	/* Continue the previous write
+					 * segment without repeated start. */
+};
+
+/* One segment of a scatter/gather transfer. */
+struct twi_segment {
+	void *buffer;
+	twi_size_t size;
+	uint8_t address;
+	uint8_t flags;			/* enum twi_segment_flags */
+};
+
 struct twi_transfer {
 	void *buffer;
 	twi_size_t write_size;
 	twi_size_t read_size;
 
 	uint8_t address;
+	uint8_t speed;			/* enum twi_speed */
+
+	/* If nr_segments is nonzero, the segments are transferred
+	 * instead of buffer, write_size, read_size and address.
+	 * The segments are joined by repeated start conditions.
+	 * The segment list must stay valid until the transfer finished.
+	 */
+	const struct twi_segment *segments;
+	uint8_t nr_segments;
 
 	twi_callback_t callback;
 
 	/* Internal fields follow. */
 	uint8_t status;			/* enum twi_transfer_status_flags */
+	uint8_t segment;		/* The current segment index. */
 	twi_size_t offset;		/* The current byte offset. */
 	struct twi_transfer *next;	/* Linked list of transfer objects. */
 };
 
+/* TWI error counters. All counters saturate. */
+struct twi_stats {
+	uint16_t errors;		/* Bus errors and missing ACKs. */
+	uint16_t timeouts;		/* Transfer timeouts. */
+	uint16_t recoveries;		/* Bus clears and re-initializations. */
+};
+
 void twi_init(void);
+void twi_systimer_tick(void);
+void twi_work(void);
+void twi_get_stats(struct twi_stats *stats);
 
 static inline void twi_transfer_init(struct twi_transfer *xfer)
 {
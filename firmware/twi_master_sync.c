@@ -8,6 +8,7 @@
 **************************************************************************/
 #include <inttypes.h>
 #include <compat/twi.h>
+#include <util/delay.h>
 
 #include "twi_master_sync.h"
 
@@ -22,6 +23,46 @@
 //#define SCL_CLOCK  50000L
 #define SCL_CLOCK	TWI_SCL_HZ
 
+/* Maximum time to wait for the TWI hardware, in microseconds */
+#define I2C_WAIT_US		1000
+/* Maximum number of start attempts in i2c_start_wait() */
+#define I2C_START_RETRIES	100
+
+
+/*************************************************************************
+ Wait for the TWI hardware to finish the current operation.
+ Return:  0 finished
+          1 timed out
+*************************************************************************/
+static unsigned char i2c_wait_twint(void)
+{
+	uint16_t i;
+
+	for (i = 0; i < I2C_WAIT_US; i++) {
+		if (TWCR & (1<<TWINT))
+			return 0;
+		_delay_us(1);
+	}
+	return 1;
+
+}/* i2c_wait_twint */
+
+
+/*************************************************************************
+ Wait for the stop condition to be executed.
+*************************************************************************/
+static void i2c_wait_stop(void)
+{
+	uint16_t i;
+
+	for (i = 0; i < I2C_WAIT_US; i++) {
+		if (!(TWCR & (1<<TWSTO)))
+			break;
+		_delay_us(1);
+	}
+
+}/* i2c_wait_stop */
+
 
 /*************************************************************************
  Initialization of the I2C bus interface. Need to be called only once
@@ -48,7 +89,7 @@ unsigned char i2c_start(unsigned char address)
 	TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
 
 	// wait until transmission completed
-	while(!(TWCR & (1<<TWINT)));
+	if (i2c_wait_twint()) return 1;
 
 	// check value of TWI Status Register. Mask prescaler bits.
 	twst = TW_STATUS & 0xF8;
@@ -59,7 +100,7 @@ unsigned char i2c_start(unsigned char address)
 	TWCR = (1<<TWINT) | (1<<TWEN);
 
 	// wail until transmission completed and ACK/NACK has been received
-	while(!(TWCR & (1<<TWINT)));
+	if (i2c_wait_twint()) return 1;
 
 	// check value of TWI Status Register. Mask prescaler bits.
 	twst = TW_STATUS & 0xF8;
@@ -72,22 +113,25 @@ unsigned char i2c_start(unsigned char address)
 
 /*************************************************************************
  Issues a start condition and sends address and transfer direction.
- If device is busy, use ack polling to wait until device is ready
+ If device is busy, use ack polling to wait until device is ready.
+ Gives up after I2C_START_RETRIES attempts.
  
  Input:   address and transfer direction of I2C device
+ Return:  0 device accessible
+          1 failed to access device
 *************************************************************************/
-void i2c_start_wait(unsigned char address)
+unsigned char i2c_start_wait(unsigned char address)
 {
-    uint8_t   twst;
+    uint8_t   twst, retries;
 
 
-    while ( 1 )
+    for ( retries = 0; retries < I2C_START_RETRIES; retries++ )
     {
 	    // send START condition
 	    TWCR = (1<<TWINT) | (1<<TWSTA) | (1<<TWEN);
     
     	// wait until transmission completed
-    	while(!(TWCR & (1<<TWINT)));
+    	if (i2c_wait_twint()) continue;
     
     	// check value of TWI Status Register. Mask prescaler bits.
     	twst = TW_STATUS & 0xF8;
@@ -98,7 +142,7 @@ void i2c_start_wait(unsigned char address)
     	TWCR = (1<<TWINT) | (1<<TWEN);
     
     	// wail until transmission completed
-    	while(!(TWCR & (1<<TWINT)));
+    	if (i2c_wait_twint()) continue;
     
     	// check value of TWI Status Register. Mask prescaler bits.
     	twst = TW_STATUS & 0xF8;
@@ -108,13 +152,14 @@ void i2c_start_wait(unsigned char address)
 	        TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
 	        
 	        // wait until stop condition is executed and bus released
-	        while(TWCR & (1<<TWSTO));
+	        i2c_wait_stop();
 	        
     	    continue;
     	}
     	//if( twst != TW_MT_SLA_ACK) return 1;
-    	break;
+    	return 0;
      }
+    return 1;
 
 }/* i2c_start_wait */
 
@@ -143,7 +188,7 @@ void i2c_stop(void)
 	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWSTO);
 	
 	// wait until stop condition is executed and bus released
-	while(TWCR & (1<<TWSTO));
+	i2c_wait_stop();
 
 }/* i2c_stop */
 
@@ -164,7 +209,7 @@ unsigned char i2c_write( unsigned char data )
 	TWCR = (1<<TWINT) | (1<<TWEN);
 
 	// wait until transmission completed
-	while(!(TWCR & (1<<TWINT)));
+	if (i2c_wait_twint()) return 1;
 
 	// check value of TWI Status Register. Mask prescaler bits
 	twst = TW_STATUS & 0xF8;
@@ -177,14 +222,20 @@ unsigned char i2c_write( unsigned char data )
 /*************************************************************************
  Read one byte from the I2C device, request more data from device 
  
- Return:  byte read from I2C device
+ Output:  byte read from I2C device
+ Return:  0 read successful
+          1 read failed
 *************************************************************************/
-unsigned char i2c_readAck(void)
+unsigned char i2c_readAck(unsigned char *data)
 {
 	TWCR = (1<<TWINT) | (1<<TWEN) | (1<<TWEA);
-	while(!(TWCR & (1<<TWINT)));    
+	if (i2c_wait_twint()) return 1;
 
-    return TWDR;
+	// check value of TWI Status Register. Mask prescaler bits
+	if ((TW_STATUS & 0xF8) != TW_MR_DATA_ACK) return 1;
+
+	*data = TWDR;
+	return 0;
 
 }/* i2c_readAck */
 
@@ -192,13 +243,19 @@ unsigned char i2c_readAck(void)
 /*************************************************************************
  Read one byte from the I2C device, read is followed by a stop condition 
  
- Return:  byte read from I2C device
+ Output:  byte read from I2C device
+ Return:  0 read successful
+          1 read failed
 *************************************************************************/
-unsigned char i2c_readNak(void)
+unsigned char i2c_readNak(unsigned char *data)
 {
 	TWCR = (1<<TWINT) | (1<<TWEN);
-	while(!(TWCR & (1<<TWINT)));
-	
-    return TWDR;
+	if (i2c_wait_twint()) return 1;
+
+	// check value of TWI Status Register. Mask prescaler bits
+	if ((TW_STATUS & 0xF8) != TW_MR_DATA_NACK) return 1;
+
+	*data = TWDR;
+	return 0;
 
 }/* i2c_readNak */
@@ -135,9 +135,10 @@ extern unsigned char i2c_rep_start(unsigned char addr);
    
  If device is busy, use ack polling to wait until device ready 
  @param    addr address and transfer direction of I2C device
- @return   none
+ @retval   0   device accessible 
+ @retval   1   failed to access device 
  */
-extern void i2c_start_wait(unsigned char addr);
+extern unsigned char i2c_start_wait(unsigned char addr);
 
  
 /**
@@ -151,15 +152,19 @@ extern unsigned char i2c_write(unsigned char data);
 
 /**
  @brief    read one byte from the I2C device, request more data from device 
- @return   byte read from I2C device
+ @param    data  byte read from I2C device
+ @retval   0 read successful
+ @retval   1 read failed
  */
-extern unsigned char i2c_readAck(void);
+extern unsigned char i2c_readAck(unsigned char *data);
 
 /**
  @brief    read one byte from the I2C device, read is followed by a stop condition 
- @return   byte read from I2C device
+ @param    data  byte read from I2C device
+ @retval   0 read successful
+ @retval   1 read failed
  */
-extern unsigned char i2c_readNak(void);
+extern unsigned char i2c_readNak(unsigned char *data);
 
 /** 
  @brief    read one byte from the I2C device
@@ -168,10 +173,12 @@ extern unsigned char i2c_readNak(void);
  
  @param    ack 1 send ack, request more data from device<br>
                0 send nak, read is followed by a stop condition 
- @return   byte read from I2C device
+ @param    data  byte read from I2C device
+ @retval   0 read successful
+ @retval   1 read failed
  */
-extern unsigned char i2c_read(unsigned char ack);
-#define i2c_read(ack)  (ack) ? i2c_readAck() : i2c_readNak(); 
+extern unsigned char i2c_read(unsigned char ack, unsigned char *data);
+#define i2c_read(ack, data)  (ack) ? i2c_readAck(data) : i2c_readNak(data); 
 
 
 /**@}*/
@@ -19,6 +19,7 @@
  */
 
 #include "util.h"
+#include "postmortem.h"
 
 #include <avr/wdt.h>
 #include <avr/eeprom.h>
@@ -35,6 +36,7 @@ void reboot(void)
 	/* Disable IRQs and use the watchdog
 	 * to trigger a watchdog reset. */
 	irq_disable();
+	postmortem_reboot();
 	wdt_enable(WDTO_15MS);
 	while (1);
 	unreachable();
@@ -43,7 +45,9 @@ void reboot(void)
 /* A fatal error occurred. */
 void panic(void)
 {
-	//TODO: Try to get an error message out.
+	/* Record the caller for the post-mortem
+	 * report after the reboot. */
+	postmortem_panic((uint16_t)(uintptr_t)__builtin_return_address(0));
 	reboot();
 }
 
@@ -32,6 +32,8 @@ class GlobalConfigWidget(QWidget):
 	configChanged = Signal()
 	# Signal: Emitted, if the RTC date or time was edited.
 	rtcEdited = Signal()
+	# Signal: Emitted, if a log configuration item changed.
+	logConfigChanged = Signal()
 
 	def __init__(self, parent):
 		"""Class constructor."""
@@ -80,6 +82,8 @@ class GlobalConfigWidget(QWidget):
 		self.stateLabel = QLabel(self)
 		self.layout().addWidget(self.stateLabel, y, 0, 1, 2)
 		y += 1
+		self.ioextStatsText = None
+		self.resetInfoText = None
 
 		self.advancedCheckBox = QCheckBox("Advanced", self)
 		self.layout().addWidget(self.advancedCheckBox, y, 0, 1, 2)
@@ -100,12 +104,35 @@ class GlobalConfigWidget(QWidget):
 		self.highestSensorSpin = ADCSpinBox(self)
 		self.advancedGroup.layout().addWidget(self.highestSensorSpin, 1, 1)
 
+		label = QLabel("Suppress repeated log messages for:", self)
+		self.advancedGroup.layout().addWidget(label, 2, 0)
+		self.logRepeatSpin = QSpinBox(self)
+		self.logRepeatSpin.setRange(0, 255)
+		self.logRepeatSpin.setSuffix(" s")
+		self.logRepeatSpin.setSpecialValueText("off")
+		self.logRepeatSpin.setValue(60)
+		self.advancedGroup.layout().addWidget(self.logRepeatSpin, 2, 1)
+
+		self.logPerCodeCheckBox = QCheckBox("Treat log messages of the same "
+						    "kind as repetitions, regardless "
+						    "of the pot", self)
+		self.advancedGroup.layout().addWidget(self.logPerCodeCheckBox, 3, 0, 1, 2)
+
+		self.logStateChgCheckBox = QCheckBox("Log state machine transitions",
+						     self)
+		self.logStateChgCheckBox.setCheckState(Qt.Checked)
+		self.advancedGroup.layout().addWidget(self.logStateChgCheckBox, 4, 0, 1, 2)
+		self.logInfoMask = 0xFFFF
+
 		self.ignoreChanges = 0
 		self.enableCheckBox.stateChanged.connect(self.__enableChanged)
 		self.rtcEditCheckBox.stateChanged.connect(self.__rtcEditChanged)
 		self.advancedCheckBox.stateChanged.connect(self.__advancedChanged)
 		self.lowestSensorSpin.valueChanged.connect(self.__lowestSensorChanged)
 		self.highestSensorSpin.valueChanged.connect(self.__highestSensorChanged)
+		self.logRepeatSpin.valueChanged.connect(self.__logConfChanged)
+		self.logPerCodeCheckBox.stateChanged.connect(self.__logConfChanged)
+		self.logStateChgCheckBox.stateChanged.connect(self.__logConfChanged)
 
 		self.__advancedChanged(self.advancedCheckBox.checkState())
 
@@ -121,6 +148,22 @@ class GlobalConfigWidget(QWidget):
 	def highestRawSensorVal(self):
 		return self.highestSensorSpin.value()
 
+	def getLogConfig(self):
+		msg = MsgLogConf(repeat_sec = self.logRepeatSpin.value())
+		if self.logPerCodeCheckBox.checkState() == Qt.Checked:
+			msg.error_code_limit = 0xFFFF
+			msg.info_code_limit = 0xFFFF
+		mask = 1 << LogItemInfo.LOG_INFO_CONTSTATCHG
+		if self.logStateChgCheckBox.checkState() == Qt.Checked:
+			msg.info_mask = self.logInfoMask | mask
+		else:
+			msg.info_mask = self.logInfoMask & ~mask
+		return msg
+
+	def __logConfChanged(self):
+		if not self.ignoreChanges:
+			self.logConfigChanged.emit()
+
 	def __lowestSensorChanged(self, newValue):
 		if not self.ignoreChanges:
 			self.configChanged.emit()
@@ -168,6 +211,20 @@ class GlobalConfigWidget(QWidget):
 		self.__shouldCheckRtc = True
 		self.ignoreChanges -= 1
 
+	def handleLogConfMessage(self, msg):
+		self.ignoreChanges += 1
+		self.logInfoMask = msg.info_mask
+		self.logRepeatSpin.setValue(msg.repeat_sec)
+		if msg.error_code_limit or msg.info_code_limit:
+			self.logPerCodeCheckBox.setCheckState(Qt.Checked)
+		else:
+			self.logPerCodeCheckBox.setCheckState(Qt.Unchecked)
+		if msg.info_mask & (1 << LogItemInfo.LOG_INFO_CONTSTATCHG):
+			self.logStateChgCheckBox.setCheckState(Qt.Checked)
+		else:
+			self.logStateChgCheckBox.setCheckState(Qt.Unchecked)
+		self.ignoreChanges -= 1
+
 	def handleGlobalStateMessage(self, msg):
 		text = []
 		if msg.flags & msg.CONTRSTAT_ONOFFSWITCH:
@@ -175,9 +232,35 @@ class GlobalConfigWidget(QWidget):
 		else:
 			text.append("Hardware switch is OFF")
 		if msg.flags & msg.CONTRSTAT_NOTIFLED:
-			text.append("Notification LED is ON")
+			names = msg.getNotifyEventNames()
+			if names:
+				text.append("Notification LED is ON (%s)" %\
+					    ", ".join(names))
+			else:
+				text.append("Notification LED is ON")
+		if msg.vcc_mv:
+			text.append("Vcc %.2f V" % (msg.vcc_mv / 1000.0))
+		if msg.temperature != msg.TEMP_UNKNOWN:
+			text.append("%d \u00B0C" % msg.temperature)
+		if msg.twi_errors or msg.twi_timeouts or msg.twi_recoveries:
+			text.append("I2C errors %d, timeouts %d, recoveries %d" %\
+				    (msg.twi_errors, msg.twi_timeouts,
+				     msg.twi_recoveries))
+		if self.ioextStatsText:
+			text.append(self.ioextStatsText)
+		if self.resetInfoText:
+			text.append(self.resetInfoText)
 		self.stateLabel.setText("; ".join(text))
 
+	def handleIoextStatsMessage(self, msg):
+		self.ioextStatsText = None
+		if msg.errors or msg.mismatches:
+			self.ioextStatsText = "Valve I/O errors %d, mismatches %d" %\
+					      (msg.errors, msg.mismatches)
+
+	def handleResetInfoMessage(self, msg):
+		self.resetInfoText = msg.getText()
+
 	def handlePotStateMessage(self, msg):
 		self.ignoreChanges += 1
 		self.statWidgets[msg.pot_number].handlePotStateMessage(msg)
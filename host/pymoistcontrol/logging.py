@@ -24,6 +24,37 @@ def controllerStateName(stateNum):
 		stateName = "%d" % stateNum
 	return stateName
 
+def resetCauseText(resetFlags):
+	"""Get the text for the MCUCSR reset flags."""
+
+	names = [ name for bit, name in ((0, "power-on"),
+					 (1, "external"),
+					 (2, "brown-out"),
+					 (3, "watchdog"))
+		  if resetFlags & (1 << bit) ]
+	return ", ".join(names) if names else "unknown"
+
+def resetPhaseName(phase):
+	"""Get the name string for a mainloop phase number."""
+
+	try:
+		phaseName = {
+			0 : "init",
+			1 : "on/off-switch",
+			2 : "communication",
+			3 : "log",
+			4 : "RTC",
+			5 : "controller",
+			6 : "valve outputs",
+			7 : "notification LED",
+			8 : "reboot",
+			9 : "PANIC",
+			15 : "unknown",
+		}[phase]
+	except KeyError:
+		phaseName = "%d" % phase
+	return phaseName
+
 class LogItem(object):
 	"""Base class for log data."""
 
@@ -37,6 +68,23 @@ class LogItem(object):
 	LOG_FLAGS_MASK		= 0x80
 	LOG_OVERFLOW		= 0x80
 
+	# Compact encoding header bits
+	CHDR_TYPE_SHIFT		= 0
+	CHDR_TYPE_MASK		= 0x03
+	CHDR_TIME_SHIFT		= 2
+	CHDR_TIME_MASK		= 0x03
+	CHDR_CODE_SHIFT		= 4
+	CHDR_CODE_MASK		= 0x0F
+
+	# Compact encoding timestamp formats
+	CTIME_SAME		= 0
+	CTIME_DELTA8		= 1
+	CTIME_DELTA16		= 2
+	CTIME_ABS		= 3
+
+	# Length of one sub-second timestamp tick (one jiffy), in milliseconds.
+	SUBSEC_MS		= 5
+
 	def __init__(self, logType, flags, timestamp, payload=b'\x00'*6):
 		"""Class constructor."""
 
@@ -44,6 +92,10 @@ class LogItem(object):
 		self.flags = flags
 		self.timestamp = timestamp
 		self.payload = payload
+		# Device log sequence number, if known.
+		self.seq = None
+		# Sub-second part of the timestamp in jiffies, if known.
+		self.subsec = None
 
 	@classmethod
 	def fromBytes(cls, b):
@@ -79,6 +131,108 @@ class LogItem(object):
 		except IndexError as e:
 			raise Error("Log item length error")
 
+	@classmethod
+	def fromCompactBytes(cls, b, baseTimestamp, subsec = False):
+		"""Decode one log item from the compact encoding.
+		'baseTimestamp' is the timestamp of the previous item.
+		'subsec' is True, if the item has a sub-second byte.
+		Returns a tuple of the log item and its encoded size."""
+
+		try:
+			header = b[0]
+			logType = (header >> cls.CHDR_TYPE_SHIFT) & cls.CHDR_TYPE_MASK
+			ctime = (header >> cls.CHDR_TIME_SHIFT) & cls.CHDR_TIME_MASK
+			code = (header >> cls.CHDR_CODE_SHIFT) & cls.CHDR_CODE_MASK
+			i = 1
+			if ctime == cls.CTIME_SAME:
+				timestamp = baseTimestamp
+			elif ctime == cls.CTIME_DELTA8:
+				timestamp = baseTimestamp + b[i]
+				i += 1
+			elif ctime == cls.CTIME_DELTA16:
+				timestamp = baseTimestamp + (b[i] | (b[i + 1] << 8))
+				i += 2
+			else:
+				timestamp = b[i] | (b[i + 1] << 8) |\
+					    (b[i + 2] << 16) | (b[i + 3] << 24)
+				i += 4
+			timestamp &= 0xFFFFFFFF
+			subsecValue = None
+			if subsec:
+				subsecValue = b[i]
+				i += 1
+			if logType == cls.LOG_SENSOR_DATA:
+				sv = (b[i] | (b[i + 1] << 8)) & 0x3FF
+				sv |= code << 10
+				payload = bytes([ sv & 0xFF, (sv >> 8) & 0xFF, ])
+				i += 2
+			else:
+				payload = bytes([ code, b[i], ])
+				i += 1
+		except IndexError as e:
+			raise Error("Compact log item length error")
+		raw = bytes([ logType,
+			      timestamp & 0xFF,
+			      (timestamp >> 8) & 0xFF,
+			      (timestamp >> 16) & 0xFF,
+			      (timestamp >> 24) & 0xFF, ]) + payload
+		item = cls.fromBytes(raw)
+		item.subsec = subsecValue
+		return (item, i)
+
+	@classmethod
+	def fromCompactStream(cls, b, count, flags = 0, subsec = False,
+			      baseTimestamp = 0):
+		"""Decode 'count' compact encoded log items.
+		'baseTimestamp' is the timestamp base of the first item.
+		'flags' are added to the first item.
+		'subsec' is True, if the items have a sub-second byte.
+		Returns a list of log items."""
+
+		items = []
+		offset = 0
+		for i in range(count):
+			item, size = cls.fromCompactBytes(b[offset:], baseTimestamp,
+							  subsec)
+			baseTimestamp = item.timestamp
+			offset += size
+			items.append(item)
+		if items:
+			items[0].flags |= flags & cls.LOG_FLAGS_MASK
+		return items
+
+	def getCompactBytes(self, baseTimestamp, subsec = False):
+		"""Get the compact encoded bytes from this log item.
+		'baseTimestamp' is the timestamp of the previous item.
+		'subsec' is True, if the sub-second byte shall be included."""
+
+		raw = self.getBytes()
+		delta = self.timestamp - baseTimestamp
+		if delta < 0 or delta > 0xFFFF:
+			ctime = self.CTIME_ABS
+			t = raw[1:5]
+		elif delta == 0:
+			ctime = self.CTIME_SAME
+			t = b''
+		elif delta <= 0xFF:
+			ctime = self.CTIME_DELTA8
+			t = bytes([ delta, ])
+		else:
+			ctime = self.CTIME_DELTA16
+			t = bytes([ delta & 0xFF, (delta >> 8) & 0xFF, ])
+		if subsec:
+			t += bytes([ (self.subsec or 0) & 0xFF, ])
+		if self.logType == self.LOG_SENSOR_DATA:
+			code = (raw[6] >> 2) & self.CHDR_CODE_MASK
+			payload = bytes([ raw[5], raw[6] & 0x03, ])
+		else:
+			code = raw[5] & self.CHDR_CODE_MASK
+			payload = raw[6:7]
+		header = ((self.logType & self.CHDR_TYPE_MASK) << self.CHDR_TYPE_SHIFT) |\
+			 (ctime << self.CHDR_TIME_SHIFT) |\
+			 (code << self.CHDR_CODE_SHIFT)
+		return bytes([ header, ]) + t + payload
+
 	def getBytes(self):
 		"""Get the raw bytes from this log item."""
 
@@ -106,8 +260,11 @@ class LogItem(object):
 		day = clamp((self.timestamp >> 17) & 0x1F, 0, 30)
 		month = clamp((self.timestamp >> 22) & 0x0F, 0, 11)
 		year = clamp((self.timestamp >> 26) & 0x3F, 0, 99)
+		msec = 0
+		if self.subsec is not None:
+			msec = clamp(self.subsec * self.SUBSEC_MS, 0, 999)
 		return QDateTime(QDate(year + 2000, month + 1, day + 1),
-				 QTime(hour, minute, second))
+				 QTime(hour, minute, second, msec))
 
 	@property
 	def overflow(self):
@@ -119,6 +276,8 @@ class LogItemError(LogItem):
 	LOG_ERR_SENSOR			= 0
 	LOG_ERR_WATERDOG		= 1
 	LOG_ERR_FREEZE			= 2
+	LOG_ERR_RTC			= 3
+	LOG_ERR_IOEXT			= 4
 
 	def __init__(self, flags, timestamp, errorCode, errorData):
 		"""Class constructor."""
@@ -149,6 +308,15 @@ class LogItemError(LogItem):
 				(potNumber + 1)
 		elif self.errorCode == self.LOG_ERR_FREEZE:
 			return "Error: A freeze timeout occurred."
+		elif self.errorCode == self.LOG_ERR_RTC:
+			return "Error: RTC EEPROM write failed "\
+				"(state %d)." % self.errorData
+		elif self.errorCode == self.LOG_ERR_IOEXT:
+			if not self.errorData:
+				return "Error: Valve output expander does "\
+					"not respond. Retrying."
+			return "Error: Valve output read-back mismatch "\
+				"(bits 0x%02X). Rewriting." % self.errorData
 		else:
 			return "Error %d (%d) occurred" %\
 				(self.errorCode, self.errorData)
@@ -158,11 +326,15 @@ class LogItemInfo(LogItem):
 	LOG_INFO_CONTSTATCHG		= 1
 	LOG_INFO_WATERINGCHG		= 2
 	LOG_INFO_HWONOFF		= 3
+	LOG_INFO_TEMPERATURE		= 4
+	LOG_INFO_PERSISTED		= 5
+	LOG_INFO_REPEATED		= 6
+	LOG_INFO_RESET			= 7
 
 	def __init__(self, flags, timestamp, infoCode, infoData):
 		"""Class constructor."""
 
-		LogItem.__init__(self, LogItem.LOG_ERROR, flags, timestamp)
+		LogItem.__init__(self, LogItem.LOG_INFO, flags, timestamp)
 		self.infoCode = infoCode
 		self.infoData = infoData
 
@@ -193,6 +365,21 @@ class LogItemInfo(LogItem):
 		elif self.infoCode == self.LOG_INFO_HWONOFF:
 			return "The hardware enable-switch was switched %s" %\
 				("ON" if (self.infoData & 0x01) else "OFF")
+		elif self.infoCode == self.LOG_INFO_TEMPERATURE:
+			return "Temperature: %d \u00B0C" % (self.infoData - 60)
+		elif self.infoCode == self.LOG_INFO_REPEATED:
+			return "The following message was repeated %d%s "\
+				"times. Repetitions were suppressed." %\
+				(self.infoData,
+				 "+" if self.infoData >= 0xFF else "")
+		elif self.infoCode == self.LOG_INFO_PERSISTED:
+			return "Device booted. The following %d errors "\
+				"were restored from the persistent log." %\
+				self.infoData
+		elif self.infoCode == self.LOG_INFO_RESET:
+			return "Device reset. Cause: %s. Phase: %s." %\
+				(resetCauseText(self.infoData & 0xF),
+				 resetPhaseName((self.infoData >> 4) & 0xF))
 		else:
 			return "Info message %d (%d)" %\
 				(self.infoCode, self.infoData)
@@ -260,18 +447,35 @@ class LogWidget(QWidget):
 		scroll.setSliderPosition(scroll.maximum())
 		scroll.setValue(scroll.maximum())
 
-	def handleLogMessage(self, msg):
-		"""Add a message to the log.
-		'msg' is an instance of a LogItem subclass."""
+	def handleLogMessage(self, msg, lost = 0):
+		"""Add the log items of a MsgLog to the log.
+		'lost' is the number of items lost before this message."""
+
+		for i, logItem in enumerate(msg.logItems):
+			self.handleLogItem(logItem, lost if i == 0 else 0)
 
-		text = msg.logItem.getText()
+	def handleLogItem(self, logItem, lost = 0):
+		"""Add a log item to the log.
+		'logItem' is an instance of a LogItem subclass.
+		'lost' is the number of items lost before this item."""
+
+		text = logItem.getText()
 		if not text:
 			return
 		if text.endswith("\n"):
 			text = text[:-1]
 		text = self.htmlEscape(text)
-		time = msg.logItem.getDateTime().toString("yyyy.MM.dd hh:mm:ss")
-		ovr = "&nbsp;QUEUE OVERFLOW" if msg.logItem.overflow else ""
+		if logItem.subsec is None:
+			fmt = "yyyy.MM.dd hh:mm:ss"
+		else:
+			fmt = "yyyy.MM.dd hh:mm:ss.zzz"
+		time = logItem.getDateTime().toString(fmt)
+		ovr = ""
+		if logItem.overflow:
+			if lost:
+				ovr = "&nbsp;QUEUE OVERFLOW: %d lost" % lost
+			else:
+				ovr = "&nbsp;QUEUE OVERFLOW"
 		text = "<i>[%s%s]</i>&nbsp;&nbsp;%s<br />" % (time, ovr, text)
 		self.messages.append(text)
 		self.__commitText()
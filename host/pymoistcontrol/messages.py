@@ -32,6 +32,16 @@ class Message(SerialMessage):
 	MSG_MAN_MODE_FETCH		= 13
 	MSG_CONTR_STATE			= 14
 	MSG_CONTR_STATE_FETCH		= 15
+	MSG_SENSOR_CONF			= 16
+	MSG_SENSOR_CONF_FETCH		= 17
+	MSG_SENSOR_STREAM		= 18
+	MSG_SENSOR_STREAM_CTL		= 19
+	MSG_LOG_CONF			= 20
+	MSG_LOG_CONF_FETCH		= 21
+	MSG_IOEXT_STATS			= 22
+	MSG_IOEXT_STATS_FETCH		= 23
+	MSG_RESET_INFO			= 24
+	MSG_RESET_INFO_FETCH		= 25
 
 	@classmethod
 	def fromRawMessage(cls, rawMsg):
@@ -44,9 +54,12 @@ class Message(SerialMessage):
 		try:
 			msgId = rawMsg.payload[0]
 			if msgId == cls.MSG_LOG:
-				msg = MsgLog(logItem = LogItem.fromBytes(rawMsg.payload[1:]))
+				msg = MsgLog.fromPayload(rawMsg.payload)
 			elif msgId == cls.MSG_LOG_FETCH:
-				msg = MsgLogFetch()
+				msg = MsgLogFetch(flags = rawMsg.payload[1],
+						  logSeq = rawMsg.payload[2] |
+							(rawMsg.payload[3] << 8),
+						  epoch = rawMsg.payload[4])
 			elif msgId == cls.MSG_RTC:
 				msg = MsgRtc(
 					second = clamp(rawMsg.payload[1], 0, 59),
@@ -77,7 +90,8 @@ class Message(SerialMessage):
 						     (rawMsg.payload[6] << 8),
 					end_time = rawMsg.payload[7] |
 						   (rawMsg.payload[8] << 8),
-					dow_on_mask = rawMsg.payload[9])
+					dow_on_mask = rawMsg.payload[9],
+					temp_coeff = toSigned8(rawMsg.payload[10]))
 			elif msgId == cls.MSG_CONTR_POT_CONF_FETCH:
 				msg = MsgContrPotConfFetch(pot_number = rawMsg.payload[1])
 			elif msgId == cls.MSG_CONTR_POT_STATE:
@@ -87,7 +101,9 @@ class Message(SerialMessage):
 					is_watering = rawMsg.payload[3],
 					last_measured_raw_value = rawMsg.payload[4] |
 								  (rawMsg.payload[5] << 8),
-					last_measured_value = rawMsg.payload[6])
+					last_measured_value = rawMsg.payload[6],
+					last_measured_asym = toSigned16(rawMsg.payload[7] |
+								       (rawMsg.payload[8] << 8)))
 			elif msgId == cls.MSG_CONTR_POT_STATE_FETCH:
 				msg = MsgContrPotStateFetch(pot_number = rawMsg.payload[1])
 			elif msgId == cls.MSG_CONTR_POT_REM_STATE:
@@ -105,9 +121,70 @@ class Message(SerialMessage):
 			elif msgId == cls.MSG_MAN_MODE_FETCH:
 				msg = MsgManModeFetch()
 			elif msgId == cls.MSG_CONTR_STATE:
-				msg = MsgContrState(flags = rawMsg.payload[1])
+				msg = MsgContrState(flags = rawMsg.payload[1],
+						    vcc_mv = rawMsg.payload[2] |
+							     (rawMsg.payload[3] << 8),
+						    temperature = toSigned8(rawMsg.payload[4]),
+						    twi_errors = rawMsg.payload[5] |
+								 (rawMsg.payload[6] << 8),
+						    twi_timeouts = rawMsg.payload[7] |
+								   (rawMsg.payload[8] << 8),
+						    twi_recoveries = rawMsg.payload[9] |
+								     (rawMsg.payload[10] << 8),
+						    notify_events = rawMsg.payload[11])
 			elif msgId == cls.MSG_CONTR_STATE_FETCH:
 				msg = MsgContrStateFetch()
+			elif msgId == cls.MSG_SENSOR_CONF:
+				msg = MsgSensorConf(
+					sensor_number = rawMsg.payload[1],
+					filter = rawMsg.payload[2],
+					nr_cycles = rawMsg.payload[3],
+					oversample = rawMsg.payload[4],
+					warmup_ms = rawMsg.payload[5] |
+						    (rawMsg.payload[6] << 8),
+					wait_ms = rawMsg.payload[7] |
+						  (rawMsg.payload[8] << 8),
+					flags = rawMsg.payload[9],
+					tuned_warmup_ms = rawMsg.payload[10] |
+							  (rawMsg.payload[11] << 8))
+			elif msgId == cls.MSG_SENSOR_CONF_FETCH:
+				msg = MsgSensorConfFetch(
+					sensor_number = rawMsg.payload[1])
+			elif msgId == cls.MSG_SENSOR_STREAM:
+				msg = MsgSensorStream.fromBytes(rawMsg.payload[1:])
+			elif msgId == cls.MSG_SENSOR_STREAM_CTL:
+				msg = MsgSensorStreamCtl(
+					enable = rawMsg.payload[1],
+					sensorMask = rawMsg.payload[2],
+					decimation = max(rawMsg.payload[3], 1))
+			elif msgId == cls.MSG_LOG_CONF:
+				msg = MsgLogConf(
+					info_mask = rawMsg.payload[1] |
+						    (rawMsg.payload[2] << 8),
+					error_code_limit = rawMsg.payload[3] |
+							   (rawMsg.payload[4] << 8),
+					info_code_limit = rawMsg.payload[5] |
+							  (rawMsg.payload[6] << 8),
+					repeat_sec = rawMsg.payload[7])
+			elif msgId == cls.MSG_LOG_CONF_FETCH:
+				msg = MsgLogConfFetch()
+			elif msgId == cls.MSG_IOEXT_STATS:
+				msg = MsgIoextStats(
+					errors = rawMsg.payload[1] |
+						 (rawMsg.payload[2] << 8),
+					mismatches = rawMsg.payload[3] |
+						     (rawMsg.payload[4] << 8))
+			elif msgId == cls.MSG_IOEXT_STATS_FETCH:
+				msg = MsgIoextStatsFetch()
+			elif msgId == cls.MSG_RESET_INFO:
+				msg = MsgResetInfo(
+					reset_flags = rawMsg.payload[1],
+					phase = rawMsg.payload[2],
+					pc = rawMsg.payload[3] |
+					     (rawMsg.payload[4] << 8),
+					pot_states = list(rawMsg.payload[5 : 5 + MAX_NR_FLOWERPOTS]))
+			elif msgId == cls.MSG_RESET_INFO_FETCH:
+				msg = MsgResetInfoFetch()
 			else:
 				raise Error("Unknown message ID: %d" % msgId)
 			msg.copyHeaderFrom(rawMsg)
@@ -132,28 +209,269 @@ class Message(SerialMessage):
 		raise NotImplementedError
 
 class MsgLog(Message):
-	def __init__(self, logItem):
-		self.logItem = logItem
+	# Mask of the item count in the 'count_flags' byte.
+	COUNT_MASK	= 0x07
+	# Flag: The message carries no items, but the device log epoch.
+	# The sequence number is the oldest item of the device log.
+	EPOCH		= 0x08
+	# Flag: The timestamp base of the first item is the last item
+	# of the previous MSG_LOG message of this fetch.
+	CHAINED		= 0x10
+	# Flag: More MSG_LOG messages of this fetch follow.
+	MORE		= 0x20
+	# Flag: The items have a sub-second timestamp byte.
+	SUBSEC		= 0x40
+
+	def __init__(self, logItems, logSeq = 0, more = False,
+		     chained = False, baseTimestamp = 0, epoch = None):
+		self.logItems = logItems
+		# Device log sequence number of the first item.
+		# Note: 'seq' is the frame sequence number.
+		self.logSeq = logSeq
+		self.more = more
+		self.chained = chained
+		self.baseTimestamp = baseTimestamp
+		# Device log epoch (boot count), if this is an epoch message.
+		self.epoch = epoch
+		self.__payload = None
+		for i, logItem in enumerate(logItems):
+			logItem.seq = (logSeq + i) & 0xFFFF
 		Message.__init__(self)
 
+	@classmethod
+	def fromPayload(cls, payload, baseTimestamp = 0):
+		"""Decode a MSG_LOG payload.
+		'baseTimestamp' is the timestamp of the last item
+		of the previous message, if the message is chained."""
+
+		logSeq = payload[2] | (payload[3] << 8)
+		if payload[1] & cls.EPOCH:
+			msg = cls(logItems = [],
+				  logSeq = logSeq,
+				  epoch = payload[4])
+			msg.__payload = payload
+			return msg
+		chained = bool(payload[1] & cls.CHAINED)
+		if not chained:
+			baseTimestamp = 0
+		msg = cls(logItems = LogItem.fromCompactStream(
+				payload[4:],
+				count = payload[1] & cls.COUNT_MASK,
+				flags = payload[1],
+				subsec = bool(payload[1] & cls.SUBSEC),
+				baseTimestamp = baseTimestamp),
+			  logSeq = logSeq,
+			  more = bool(payload[1] & cls.MORE),
+			  chained = chained,
+			  baseTimestamp = baseTimestamp)
+		msg.__payload = payload
+		return msg
+
+	def rebase(self, baseTimestamp):
+		"""Decode a chained message again with the timestamp
+		of the last item of the previous message."""
+
+		if not self.chained or self.__payload is None:
+			return self
+		msg = MsgLog.fromPayload(self.__payload, baseTimestamp)
+		msg.copyHeaderFrom(self)
+		return msg
+
+	def nextSeq(self):
+		"""Get the sequence number following the last item."""
+
+		return (self.logSeq + len(self.logItems)) & 0xFFFF
+
 	def getType(self):
 		return self.MSG_LOG
 
 	def getPayload(self):
-		payload = bytes([ self.getType() ])
-		payload += self.logItem.getBytes()
+		if self.epoch is not None:
+			return bytes([ self.getType(),
+				       self.EPOCH,
+				       self.logSeq & 0xFF,
+				       (self.logSeq >> 8) & 0xFF,
+				       self.epoch & 0xFF, ])
+		flags = 0
+		if self.logItems:
+			flags = self.logItems[0].flags & LogItem.LOG_FLAGS_MASK
+		subsec = any(item.subsec is not None for item in self.logItems)
+		if subsec:
+			flags |= self.SUBSEC
+		if self.more:
+			flags |= self.MORE
+		baseTimestamp = 0
+		if self.chained:
+			flags |= self.CHAINED
+			baseTimestamp = self.baseTimestamp
+		payload = bytes([ self.getType(),
+				  (len(self.logItems) & self.COUNT_MASK) | flags,
+				  self.logSeq & 0xFF,
+				  (self.logSeq >> 8) & 0xFF, ])
+		for logItem in self.logItems:
+			payload += logItem.getCompactBytes(baseTimestamp, subsec)
+			baseTimestamp = logItem.timestamp
 		return payload
 
-class MsgLogFetch(Message):
+class MsgLogConf(Message):
+	def __init__(self,
+		     info_mask = 0xFFFF,
+		     error_code_limit = 0,
+		     info_code_limit = 0,
+		     repeat_sec = 60):
+		self.info_mask = info_mask
+		self.error_code_limit = error_code_limit
+		self.info_code_limit = info_code_limit
+		self.repeat_sec = repeat_sec
+		Message.__init__(self)
+
+	def getType(self):
+		return self.MSG_LOG_CONF
+
+	def getPayload(self):
+		return bytes([ self.getType(),
+			       self.info_mask & 0xFF,
+			       (self.info_mask >> 8) & 0xFF,
+			       self.error_code_limit & 0xFF,
+			       (self.error_code_limit >> 8) & 0xFF,
+			       self.info_code_limit & 0xFF,
+			       (self.info_code_limit >> 8) & 0xFF,
+			       clamp(self.repeat_sec, 0, 255), ])
+
+	def toText(self):
+		return "[LOG_CONFIG]\n" \
+		       "info_mask=%d\n" \
+		       "error_code_limit=%d\n" \
+		       "info_code_limit=%d\n" \
+		       "repeat_sec=%d\n" % \
+		       (self.info_mask,
+			self.error_code_limit,
+			self.info_code_limit,
+			self.repeat_sec)
+
+	def fromText(self, text):
+		try:
+			p = configparser.ConfigParser()
+			p.read_string(text)
+			self.info_mask = p.getint("LOG_CONFIG", "info_mask")
+			self.error_code_limit = p.getint("LOG_CONFIG",
+							 "error_code_limit")
+			self.info_code_limit = p.getint("LOG_CONFIG",
+							"info_code_limit")
+			self.repeat_sec = p.getint("LOG_CONFIG", "repeat_sec")
+		except configparser.Error as e:
+			raise Error(str(e))
+
+class MsgLogConfFetch(Message):
 	def __init__(self):
 		Message.__init__(self, fc = Message.COMM_FC_REQ_ACK)
 
 	def getType(self):
-		return self.MSG_LOG_FETCH
+		return self.MSG_LOG_CONF_FETCH
 
 	def getPayload(self):
 		return bytes([ self.getType(), ])
 
+class MsgIoextStats(Message):
+	def __init__(self,
+		     errors = 0,
+		     mismatches = 0):
+		# Failed transfers.
+		self.errors = errors
+		# Read-backs that differed from the written state.
+		self.mismatches = mismatches
+		Message.__init__(self)
+
+	def getType(self):
+		return self.MSG_IOEXT_STATS
+
+	def getPayload(self):
+		return bytes([ self.getType(),
+			       self.errors & 0xFF,
+			       (self.errors >> 8) & 0xFF,
+			       self.mismatches & 0xFF,
+			       (self.mismatches >> 8) & 0xFF, ])
+
+class MsgIoextStatsFetch(Message):
+	def __init__(self):
+		Message.__init__(self, fc = Message.COMM_FC_REQ_ACK)
+
+	def getType(self):
+		return self.MSG_IOEXT_STATS_FETCH
+
+	def getPayload(self):
+		return bytes([ self.getType(), ])
+
+class MsgResetInfo(Message):
+	def __init__(self,
+		     reset_flags = 0,
+		     phase = 0xF,
+		     pc = 0,
+		     pot_states = [ 0, ] * MAX_NR_FLOWERPOTS):
+		self.reset_flags = reset_flags
+		self.phase = phase
+		self.pc = pc
+		self.pot_states = pot_states
+		Message.__init__(self)
+
+	def getType(self):
+		return self.MSG_RESET_INFO
+
+	def getPayload(self):
+		return bytes([ self.getType(),
+			       self.reset_flags,
+			       self.phase,
+			       self.pc & 0xFF,
+			       (self.pc >> 8) & 0xFF, ] +\
+			     list(self.pot_states))
+
+	def getText(self):
+		"""Get a string representation of the reset info."""
+
+		text = [ "Last reset: %s in phase %s" %\
+			 (resetCauseText(self.reset_flags),
+			  resetPhaseName(self.phase)) ]
+		if self.pc:
+			text.append("panic caller at word address 0x%04X" %\
+				    self.pc)
+		for i, state in enumerate(self.pot_states):
+			if state & 0x80:
+				text.append("pot %d was watering (%s)" %\
+					    (i + 1, controllerStateName(state & 0x7F)))
+		return ", ".join(text)
+
+class MsgResetInfoFetch(Message):
+	def __init__(self):
+		Message.__init__(self, fc = Message.COMM_FC_REQ_ACK)
+
+	def getType(self):
+		return self.MSG_RESET_INFO_FETCH
+
+	def getPayload(self):
+		return bytes([ self.getType(), ])
+
+class MsgLogFetch(Message):
+	# Flags
+	LOGFETCH_RESYNC	= 1 << 0
+
+	def __init__(self, logSeq = 0, flags = LOGFETCH_RESYNC, epoch = 0):
+		# Requested device log sequence number.
+		self.logSeq = logSeq
+		# Device log epoch the sequence number belongs to.
+		self.epoch = epoch
+		self.flags = flags
+		Message.__init__(self, fc = Message.COMM_FC_REQ_ACK)
+
+	def getType(self):
+		return self.MSG_LOG_FETCH
+
+	def getPayload(self):
+		return bytes([ self.getType(),
+			       self.flags & 0xFF,
+			       self.logSeq & 0xFF,
+			       (self.logSeq >> 8) & 0xFF,
+			       self.epoch & 0xFF, ])
+
 class MsgRtc(Message):
 	def __init__(self,
 		     second = 0, minute = 0, hour = 0, day = 0,
@@ -310,7 +628,8 @@ class MsgContrPotConf(Message):
 		     max_threshold = 0,
 		     start_time = 0,
 		     end_time = 0,
-		     dow_on_mask = 0):
+		     dow_on_mask = 0,
+		     temp_coeff = 0):
 		self.pot_number = pot_number
 		self.flags = flags
 		self.min_threshold = min_threshold
@@ -318,6 +637,7 @@ class MsgContrPotConf(Message):
 		self.start_time = start_time
 		self.end_time = end_time
 		self.dow_on_mask = dow_on_mask
+		self.temp_coeff = temp_coeff
 		Message.__init__(self)
 
 	def getType(self):
@@ -333,7 +653,8 @@ class MsgContrPotConf(Message):
 			       (self.start_time >> 8) & 0xFF,
 			       self.end_time & 0xFF,
 			       (self.end_time >> 8) & 0xFF,
-			       self.dow_on_mask & 0xFF, ])
+			       self.dow_on_mask & 0xFF,
+			       clamp(self.temp_coeff, -128, 127) & 0xFF, ])
 
 	def toText(self):
 		return "[POT_%d_CONFIG]\n" \
@@ -342,14 +663,16 @@ class MsgContrPotConf(Message):
 		       "max_threshold=%d\n" \
 		       "start_time=%d\n" \
 		       "end_time=%d\n" \
-		       "dow_on_mask=%d\n" % \
+		       "dow_on_mask=%d\n" \
+		       "temp_coeff=%d\n" % \
 		       (self.pot_number,
 			self.flags,
 			self.min_threshold,
 			self.max_threshold,
 			self.start_time,
 			self.end_time,
-			self.dow_on_mask)
+			self.dow_on_mask,
+			self.temp_coeff)
 
 	def fromText(self, text):
 		try:
@@ -367,6 +690,8 @@ class MsgContrPotConf(Message):
 						 "end_time")
 			self.dow_on_mask = p.getint("POT_%d_CONFIG" % self.pot_number,
 						    "dow_on_mask")
+			self.temp_coeff = p.getint("POT_%d_CONFIG" % self.pot_number,
+						   "temp_coeff", fallback = 0)
 		except configparser.Error as e:
 			raise Error(str(e))
 
@@ -388,12 +713,14 @@ class MsgContrPotState(Message):
 		     state_id = 0,
 		     is_watering = 0,
 		     last_measured_raw_value = 0,
-		     last_measured_value = 0):
+		     last_measured_value = 0,
+		     last_measured_asym = 0):
 		self.pot_number = pot_number
 		self.state_id = state_id
 		self.is_watering = is_watering
 		self.last_measured_raw_value = last_measured_raw_value
 		self.last_measured_value = last_measured_value
+		self.last_measured_asym = last_measured_asym
 		Message.__init__(self)
 
 	def getType(self):
@@ -406,7 +733,9 @@ class MsgContrPotState(Message):
 			       self.is_watering & 0xFF,
 			       self.last_measured_raw_value & 0xFF,
 			       (self.last_measured_raw_value >> 8) & 0xFF,
-			       self.last_measured_value & 0xFF, ])
+			       self.last_measured_value & 0xFF,
+			       self.last_measured_asym & 0xFF,
+			       (self.last_measured_asym >> 8) & 0xFF, ])
 
 class MsgContrPotStateFetch(Message):
 	def __init__(self, pot_number):
@@ -494,9 +823,33 @@ class MsgContrState(Message):
 	CONTRSTAT_ONOFFSWITCH	= 1 << 0
 	CONTRSTAT_NOTIFLED	= 1 << 1
 
+	# Temperature value for "temperature not known"
+	TEMP_UNKNOWN		= -128
+
+	# Notification LED events, in priority order
+	NOTIFY_EVENT_NAMES	= ( "watering watchdog",
+				    "valve output",
+				    "sensor",
+				    "freeze timeout",
+				    "RTC",
+				    "hardware switch",
+				    "host", )
+
 	def __init__(self,
-		     flags = 0):
+		     flags = 0,
+		     vcc_mv = 0,
+		     temperature = TEMP_UNKNOWN,
+		     twi_errors = 0,
+		     twi_timeouts = 0,
+		     twi_recoveries = 0,
+		     notify_events = 0):
 		self.flags = flags
+		self.vcc_mv = vcc_mv
+		self.temperature = temperature
+		self.twi_errors = twi_errors
+		self.twi_timeouts = twi_timeouts
+		self.twi_recoveries = twi_recoveries
+		self.notify_events = notify_events
 		Message.__init__(self)
 
 	def getType(self):
@@ -504,7 +857,23 @@ class MsgContrState(Message):
 
 	def getPayload(self):
 		return bytes([ self.getType(),
-			       self.flags, ])
+			       self.flags,
+			       self.vcc_mv & 0xFF,
+			       (self.vcc_mv >> 8) & 0xFF,
+			       self.temperature & 0xFF,
+			       self.twi_errors & 0xFF,
+			       (self.twi_errors >> 8) & 0xFF,
+			       self.twi_timeouts & 0xFF,
+			       (self.twi_timeouts >> 8) & 0xFF,
+			       self.twi_recoveries & 0xFF,
+			       (self.twi_recoveries >> 8) & 0xFF,
+			       self.notify_events & 0xFF, ])
+
+	def getNotifyEventNames(self):
+		"""Get the names of the active notification LED events."""
+
+		return [ name for i, name in enumerate(self.NOTIFY_EVENT_NAMES)
+			 if self.notify_events & (1 << i) ]
 
 class MsgContrStateFetch(Message):
 	def __init__(self):
@@ -515,3 +884,180 @@ class MsgContrStateFetch(Message):
 
 	def getPayload(self):
 		return bytes([ self.getType(), ])
+
+class MsgSensorConf(Message):
+	FILTER_MEDIAN		= 0
+	FILTER_TRIMMEDMEAN	= 1
+	FILTER_IIR		= 2
+
+	SENSOR_FLG_AUTOTUNE	= 0x01
+
+	MAX_CYCLES		= 8
+	MAX_OVERSAMPLE		= 4
+	MIN_WARMUP_MS		= 5
+	MAX_WARMUP_MS		= 1000
+	MAX_WAIT_MS		= 10000
+
+	def __init__(self,
+		     sensor_number,
+		     filter = FILTER_MEDIAN,
+		     nr_cycles = 3,
+		     oversample = 2,
+		     warmup_ms = 50,
+		     wait_ms = 500,
+		     flags = 0,
+		     tuned_warmup_ms = 0):
+		self.sensor_number = sensor_number
+		self.filter = filter
+		self.nr_cycles = nr_cycles
+		self.oversample = oversample
+		self.warmup_ms = warmup_ms
+		self.wait_ms = wait_ms
+		self.flags = flags
+		self.tuned_warmup_ms = tuned_warmup_ms
+		Message.__init__(self)
+
+	def getType(self):
+		return self.MSG_SENSOR_CONF
+
+	def getPayload(self):
+		warmup = clamp(self.warmup_ms,
+			       self.MIN_WARMUP_MS, self.MAX_WARMUP_MS)
+		wait = clamp(self.wait_ms, 0, self.MAX_WAIT_MS)
+		return bytes([ self.getType(),
+			       self.sensor_number & 0xFF,
+			       self.filter & 0xFF,
+			       clamp(self.nr_cycles, 1, self.MAX_CYCLES),
+			       clamp(self.oversample, 0, self.MAX_OVERSAMPLE),
+			       warmup & 0xFF,
+			       (warmup >> 8) & 0xFF,
+			       wait & 0xFF,
+			       (wait >> 8) & 0xFF,
+			       self.flags & 0xFF, ])
+
+	def toText(self):
+		return "[SENSOR_%d_CONFIG]\n" \
+		       "filter=%d\n" \
+		       "nr_cycles=%d\n" \
+		       "oversample=%d\n" \
+		       "warmup_ms=%d\n" \
+		       "wait_ms=%d\n" \
+		       "flags=%d\n" % \
+		       (self.sensor_number,
+			self.filter,
+			self.nr_cycles,
+			self.oversample,
+			self.warmup_ms,
+			self.wait_ms,
+			self.flags)
+
+	def fromText(self, text):
+		try:
+			p = configparser.ConfigParser()
+			p.read_string(text)
+			section = "SENSOR_%d_CONFIG" % self.sensor_number
+			self.filter = p.getint(section, "filter")
+			self.nr_cycles = clamp(p.getint(section, "nr_cycles"),
+					       1, self.MAX_CYCLES)
+			self.oversample = clamp(p.getint(section, "oversample"),
+						0, self.MAX_OVERSAMPLE)
+			self.warmup_ms = clamp(p.getint(section, "warmup_ms",
+							fallback = 50),
+					       self.MIN_WARMUP_MS,
+					       self.MAX_WARMUP_MS)
+			self.wait_ms = clamp(p.getint(section, "wait_ms",
+						      fallback = 500),
+					     0, self.MAX_WAIT_MS)
+			self.flags = p.getint(section, "flags", fallback = 0)
+		except configparser.Error as e:
+			raise Error(str(e))
+
+class MsgSensorConfFetch(Message):
+	def __init__(self, sensor_number):
+		self.sensor_number = sensor_number
+		Message.__init__(self, fc = Message.COMM_FC_REQ_ACK)
+
+	def getType(self):
+		return self.MSG_SENSOR_CONF_FETCH
+
+	def getPayload(self):
+		return bytes([ self.getType(),
+			       self.sensor_number & 0xFF, ])
+
+class SensorStreamSample(object):
+	"""One raw ADC conversion of the sensor stream."""
+
+	SIZE = 4
+
+	def __init__(self, jiffies = 0, value = 0, polarity = 0,
+		     sensor_number = 0, lost = False):
+		self.jiffies = jiffies
+		self.value = value
+		self.polarity = polarity
+		self.sensor_number = sensor_number
+		self.lost = lost
+
+	@classmethod
+	def fromBytes(cls, data):
+		jiffies = data[0] | (data[1] << 8)
+		word = data[2] | (data[3] << 8)
+		return cls(jiffies = jiffies,
+			   value = word & 0x3FF,
+			   polarity = (word >> 10) & 1,
+			   sensor_number = (word >> 11) & 7,
+			   lost = bool(word & 0x8000))
+
+	def getBytes(self):
+		word = (self.value & 0x3FF) |\
+		       ((self.polarity & 1) << 10) |\
+		       ((self.sensor_number & 7) << 11) |\
+		       (0x8000 if self.lost else 0)
+		return bytes([ self.jiffies & 0xFF,
+			       (self.jiffies >> 8) & 0xFF,
+			       word & 0xFF,
+			       (word >> 8) & 0xFF, ])
+
+class MsgSensorStream(Message):
+	MAX_SAMPLES = 2
+
+	@classmethod
+	def fromBytes(cls, data):
+		count = min(data[0], cls.MAX_SAMPLES)
+		samples = []
+		for i in range(count):
+			offset = 1 + i * SensorStreamSample.SIZE
+			samples.append(SensorStreamSample.fromBytes(
+				data[offset : offset + SensorStreamSample.SIZE]))
+		return cls(samples)
+
+	def __init__(self, samples = []):
+		self.samples = samples
+		Message.__init__(self)
+
+	def getType(self):
+		return self.MSG_SENSOR_STREAM
+
+	def getPayload(self):
+		payload = bytes([ self.getType(),
+				  len(self.samples), ])
+		for sample in self.samples:
+			payload += sample.getBytes()
+		return payload
+
+class MsgSensorStreamCtl(Message):
+	def __init__(self, enable = 0, sensorMask = 0, decimation = 1):
+		self.enable = enable
+		# Bitmask of the streamed sensors. 0 selects all sensors.
+		self.sensorMask = sensorMask
+		# Only every n-th conversion is streamed.
+		self.decimation = decimation
+		Message.__init__(self, fc = Message.COMM_FC_REQ_ACK)
+
+	def getType(self):
+		return self.MSG_SENSOR_STREAM_CTL
+
+	def getPayload(self):
+		return bytes([ self.getType(),
+			       1 if self.enable else 0,
+			       self.sensorMask & 0xFF,
+			       clamp(self.decimation, 1, 255), ])
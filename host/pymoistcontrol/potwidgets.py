@@ -65,6 +65,9 @@ class PotWidget(QWidget):
 	manModeChanged = Signal()
 	# Signal: Emitted, if a watchdog restart was requested.
 	watchdogRestartReq = Signal(int)
+	# Signal: Emitted, if a sensor configuration item changed.
+	#         The first parameter (int) is the sensor number.
+	sensorConfigChanged = Signal(int)
 
 	def __init__(self, potNumber, parent):
 		"""Class constructor."""
@@ -180,6 +183,11 @@ class PotWidget(QWidget):
 		self.rawAdc = QLabel(self)
 		self.advancedGroup.layout().addWidget(self.rawAdc, yAdv, 1)
 		yAdv += 1
+		label = QLabel("Polarity asymmetry:", self)
+		self.advancedGroup.layout().addWidget(label, yAdv, 0)
+		self.asymAdc = QLabel(self)
+		self.advancedGroup.layout().addWidget(self.asymAdc, yAdv, 1)
+		yAdv += 1
 		label = QLabel("Watering state:", self)
 		self.advancedGroup.layout().addWidget(label, yAdv, 0)
 		self.wateringIndi = BitIndicator(offText = "Not watering",
@@ -197,6 +205,70 @@ class PotWidget(QWidget):
 		yAdv += 1
 		self.verboseLogCheckBox = QCheckBox("Enable verbose logging", self)
 		self.advancedGroup.layout().addWidget(self.verboseLogCheckBox, yAdv, 0, 1, 2)
+		yAdv += 1
+		label = QLabel("Temperature coefficient:", self)
+		self.advancedGroup.layout().addWidget(label, yAdv, 0)
+		self.tempCoeff = QDoubleSpinBox(self)
+		self.tempCoeff.setRange(-12.8, 12.7)
+		self.tempCoeff.setDecimals(1)
+		self.tempCoeff.setSingleStep(0.1)
+		self.tempCoeff.setSuffix(" %/\u00B0C")
+		self.tempCoeff.setToolTip("Sensor value change per degree Celsius, "
+					  "relative to 20 \u00B0C.\n"
+					  "0 disables the temperature compensation.")
+		self.tempCoeff.setValue(0.0)
+		self.advancedGroup.layout().addWidget(self.tempCoeff, yAdv, 1)
+		yAdv += 1
+		label = QLabel("Measurement cycles:", self)
+		self.advancedGroup.layout().addWidget(label, yAdv, 0)
+		self.sensorCycles = QSpinBox(self)
+		self.sensorCycles.setRange(1, MsgSensorConf.MAX_CYCLES)
+		self.sensorCycles.setValue(3)
+		self.advancedGroup.layout().addWidget(self.sensorCycles, yAdv, 1)
+		yAdv += 1
+		label = QLabel("ADC oversampling:", self)
+		self.advancedGroup.layout().addWidget(label, yAdv, 0)
+		self.sensorOversample = QComboBox(self)
+		for i in range(MsgSensorConf.MAX_OVERSAMPLE + 1):
+			self.sensorOversample.addItem("%d x" % (1 << i), i)
+		self.advancedGroup.layout().addWidget(self.sensorOversample, yAdv, 1)
+		yAdv += 1
+		label = QLabel("Measurement filter:", self)
+		self.advancedGroup.layout().addWidget(label, yAdv, 0)
+		self.sensorFilter = QComboBox(self)
+		self.sensorFilter.addItem("Median",
+					  MsgSensorConf.FILTER_MEDIAN)
+		self.sensorFilter.addItem("Trimmed mean",
+					  MsgSensorConf.FILTER_TRIMMEDMEAN)
+		self.sensorFilter.addItem("IIR lowpass",
+					  MsgSensorConf.FILTER_IIR)
+		self.advancedGroup.layout().addWidget(self.sensorFilter, yAdv, 1)
+		yAdv += 1
+		label = QLabel("Sensor warmup time:", self)
+		self.advancedGroup.layout().addWidget(label, yAdv, 0)
+		hbox = QHBoxLayout()
+		self.sensorWarmup = QSpinBox(self)
+		self.sensorWarmup.setRange(MsgSensorConf.MIN_WARMUP_MS,
+					   MsgSensorConf.MAX_WARMUP_MS)
+		self.sensorWarmup.setSingleStep(5)
+		self.sensorWarmup.setSuffix(" ms")
+		self.sensorWarmup.setValue(50)
+		hbox.addWidget(self.sensorWarmup)
+		self.sensorAutotune = QCheckBox("Auto-tune", self)
+		hbox.addWidget(self.sensorAutotune)
+		self.sensorTunedWarmup = QLabel(self)
+		hbox.addWidget(self.sensorTunedWarmup)
+		hbox.addStretch()
+		self.advancedGroup.layout().addLayout(hbox, yAdv, 1)
+		yAdv += 1
+		label = QLabel("Sensor wait time:", self)
+		self.advancedGroup.layout().addWidget(label, yAdv, 0)
+		self.sensorWait = QSpinBox(self)
+		self.sensorWait.setRange(0, MsgSensorConf.MAX_WAIT_MS)
+		self.sensorWait.setSingleStep(50)
+		self.sensorWait.setSuffix(" ms")
+		self.sensorWait.setValue(500)
+		self.advancedGroup.layout().addWidget(self.sensorWait, yAdv, 1)
 
 		self.layout().setRowStretch(y, 1)
 
@@ -212,11 +284,18 @@ class PotWidget(QWidget):
 		self.startTime.timeChanged.connect(self.__startTimeChanged)
 		self.endTimeCheckBox.stateChanged.connect(self.__endTimeChanged)
 		self.endTime.timeChanged.connect(self.__endTimeChanged)
+		self.tempCoeff.valueChanged.connect(self.__tempCoeffChanged)
 		self.forceOpenButton.pressed.connect(self.__forceOpenPressed)
 		self.forceOpenButton.released.connect(self.__forceOpenReleased)
 		self.forceStartMeasurement.pressed.connect(self.__forceStartMeasPressed)
 		self.forceStopWateringButton.pressed.connect(self.__forceStopWaterPressed)
 		self.advancedCheckBox.stateChanged.connect(self.__advancedChanged)
+		self.sensorCycles.valueChanged.connect(self.__sensorConfChanged)
+		self.sensorOversample.currentIndexChanged.connect(self.__sensorConfChanged)
+		self.sensorFilter.currentIndexChanged.connect(self.__sensorConfChanged)
+		self.sensorWarmup.valueChanged.connect(self.__sensorConfChanged)
+		self.sensorAutotune.stateChanged.connect(self.__sensorConfChanged)
+		self.sensorWait.valueChanged.connect(self.__sensorConfChanged)
 
 		self.__advancedChanged(self.advancedCheckBox.checkState())
 		self.resetState()
@@ -242,6 +321,9 @@ class PotWidget(QWidget):
 	def getDowEnableMask(self):
 		return boolListToBitMask(self.dowEnable.getStates())
 
+	def getTempCoeff(self):
+		return int(round(self.tempCoeff.value() * 10))
+
 	def getStartTime(self):
 		if self.startTimeCheckBox.checkState() == Qt.Checked:
 			t = self.startTime.time()
@@ -270,6 +352,24 @@ class PotWidget(QWidget):
 	def getMaxThreshold(self):
 		return min(0xFF, self.minThreshold.value() + self.hyst.value())
 
+	def getSensorCycles(self):
+		return self.sensorCycles.value()
+
+	def getSensorOversample(self):
+		return self.sensorOversample.itemData(self.sensorOversample.currentIndex())
+
+	def getSensorFilter(self):
+		return self.sensorFilter.itemData(self.sensorFilter.currentIndex())
+
+	def getSensorWarmup(self):
+		return self.sensorWarmup.value()
+
+	def getSensorWait(self):
+		return self.sensorWait.value()
+
+	def sensorAutotuneEnabled(self):
+		return self.sensorAutotune.checkState() == Qt.Checked
+
 	def __advancedChanged(self, newState):
 		if newState == Qt.Checked:
 			self.advancedGroup.show()
@@ -330,6 +430,14 @@ class PotWidget(QWidget):
 				self.ignoreChanges -= 1
 			self.configChanged.emit(self.potNumber)
 
+	def __tempCoeffChanged(self, newValue):
+		if not self.ignoreChanges:
+			self.configChanged.emit(self.potNumber)
+
+	def __sensorConfChanged(self):
+		if not self.ignoreChanges:
+			self.sensorConfigChanged.emit(self.potNumber)
+
 	def __forceOpenPressed(self):
 		if not self.ignoreChanges:
 			self.manModeChanged.emit()
@@ -376,6 +484,27 @@ class PotWidget(QWidget):
 			self.endTimeCheckBox.setCheckState(Qt.Checked)
 			self.endTime.setTime(QTime(h, m, s))
 		self.dowEnable.setStates(bitMaskToBoolList(msg.dow_on_mask))
+		self.tempCoeff.setValue(msg.temp_coeff / 10.0)
+		self.ignoreChanges -= 1
+
+	def handleSensorConfMessage(self, msg):
+		self.ignoreChanges += 1
+		assert(msg.sensor_number == self.potNumber)
+		self.sensorCycles.setValue(msg.nr_cycles)
+		index = self.sensorOversample.findData(msg.oversample)
+		if index >= 0:
+			self.sensorOversample.setCurrentIndex(index)
+		index = self.sensorFilter.findData(msg.filter)
+		if index >= 0:
+			self.sensorFilter.setCurrentIndex(index)
+		self.sensorWarmup.setValue(msg.warmup_ms)
+		self.sensorWait.setValue(msg.wait_ms)
+		if msg.flags & msg.SENSOR_FLG_AUTOTUNE:
+			self.sensorAutotune.setCheckState(Qt.Checked)
+			self.sensorTunedWarmup.setText("(now %d ms)" % msg.tuned_warmup_ms)
+		else:
+			self.sensorAutotune.setCheckState(Qt.Unchecked)
+			self.sensorTunedWarmup.setText("")
 		self.ignoreChanges -= 1
 
 	def handlePotStateMessage(self, msg):
@@ -386,6 +515,7 @@ class PotWidget(QWidget):
 		self.wateringIndi.setState(msg.is_watering)
 		self.forceStopWateringButton.setEnabled(msg.is_watering)
 		self.rawAdc.setText("%d" % msg.last_measured_raw_value)
+		self.asymAdc.setText("%d" % msg.last_measured_asym)
 		self.stateMachineText.setText(controllerStateName(msg.state_id))
 		self.ignoreChanges -= 1
 
@@ -404,6 +534,7 @@ class PotWidget(QWidget):
 		self.statWidget.enableMessageHandling(self.isEnabled())
 		self.wateringIndi.setState(False)
 		self.rawAdc.setText("None")
+		self.asymAdc.setText("None")
 		self.stateMachineText.setText("Disabled")
 		self.watchdogGroup.hide()
 		self.ignoreChanges -= 1
@@ -27,6 +27,16 @@ def clamp(value, minValue, maxValue):
 	"""Limit 'value' to the range 'minValue':'maxValue'"""
 	return max(min(value, maxValue), minValue)
 
+def toSigned8(value):
+	"""Convert an unsigned 8 bit integer to a signed integer."""
+	value &= 0xFF
+	return value - 0x100 if value & 0x80 else value
+
+def toSigned16(value):
+	"""Convert an unsigned 16 bit integer to a signed integer."""
+	value &= 0xFFFF
+	return value - 0x10000 if value & 0x8000 else value
+
 def boolListToBitMask(boolList):
 	"""Convert an iterable of Bools to an integer bit-mask."""
 	mask = 0